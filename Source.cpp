@@ -3,6 +3,35 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <memory>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <random>
+#include <cmath>
+#include <functional>
+#ifdef __linux__
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
 using namespace std;
 
 const int screenWidth = 1200;
@@ -36,801 +65,4376 @@ struct Move {
     PieceType capturedType = NONE;
 };
 
+// Compact rules core used by the headless tools. Squares are indexed y * 8 + x with the same
+// orientation as the on-screen board (y = 0 is Black's back rank, so a8 = 0 and h1 = 63).
+// A square holds 0 when empty, otherwise (PieceType + 1) with 8 added for Black.
+typedef uint16_t MoveCode; // from | to << 6 | promotion << 12 (PAWN means no promotion)
+
+inline int MoveFrom(MoveCode m) { return m & 63; }
+inline int MoveTo(MoveCode m) { return (m >> 6) & 63; }
+inline PieceType MovePromotion(MoveCode m) { return (PieceType)((m >> 12) & 7); }
+inline MoveCode MakeMoveCode(int from, int to, PieceType promotion = PAWN) { return (MoveCode)(from | (to << 6) | (promotion << 12)); }
+
+inline unsigned char MakePieceCode(PieceType type, bool isWhite) { return (unsigned char)((type + 1) | (isWhite ? 0 : 8)); }
+inline PieceType PieceCodeType(unsigned char code) { return code ? (PieceType)((code & 7) - 1) : NONE; }
+inline bool PieceCodeWhite(unsigned char code) { return !(code & 8); }
+
+// Nominal piece values for static exchange, capture ordering and pruning, indexed by PieceType. A
+// capture onto an empty square is en passant, so NONE is worth a pawn.
+const int pieceValue[7] = { 100, 500, 320, 330, 900, 0, 100 };
+// Attacker order for least-valuable-attacker and MVV-LVA ties, cheapest first, indexed by PieceType.
+const int attackerRank[6] = { 0, 3, 1, 2, 4, 5 };
+
+enum CastlingRight { WHITE_KINGSIDE = 1, WHITE_QUEENSIDE = 2, BLACK_KINGSIDE = 4, BLACK_QUEENSIDE = 8 };
+// Ordered so that everything from PLAY_CHECKMATE on ends the game and from PLAY_STALEMATE on is a draw.
+enum PlayStatus { PLAY_ONGOING, PLAY_CHECK, PLAY_CHECKMATE, PLAY_STALEMATE, PLAY_DRAW_FIFTY, PLAY_DRAW_REPETITION, PLAY_DRAW_MATERIAL };
+
+const int maxMoves = 256;
+
+// Zobrist keys come from a fixed seed so position keys are stable across runs and builds.
+struct ZobristKeys {
+    uint64_t piece[16][64];
+    uint64_t castling[16];
+    uint64_t epFile[8];
+    uint64_t blackToMove;
+
+    ZobristKeys() {
+        uint64_t state = 0x43484545535943ull; // "CHEESYC"
+        auto next = [&]() {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        };
+        for (auto& squares : piece) {
+            for (auto& key : squares) key = next();
+        }
+        for (auto& key : castling) key = next();
+        for (auto& key : epFile) key = next();
+        blackToMove = next();
+    }
+};
+
+const ZobristKeys zobrist;
+
+struct Position {
+    unsigned char board[64] = {};
+    bool whiteToMove = true;
+    unsigned char castling = 0;
+    signed char epSquare = -1; // square a pawn may capture onto en passant, -1 if none
+    uint16_t halfmoveClock = 0;
+    uint16_t fullmoveNumber = 1;
+
+    void SetStartPosition() {
+        SetFromFEN("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    }
+
+    bool SetFromFEN(const string& fen) {
+        static const char pieceLetters[] = "prnbqk";
+        Position parsed;
+        size_t i = 0;
+        int x = 0, y = 0;
+        for (; i < fen.size() && fen[i] != ' '; i++) {
+            char c = fen[i];
+            if (c == '/') { x = 0; y++; continue; }
+            if (c >= '1' && c <= '8') { x += c - '0'; continue; }
+            const char* letter = strchr(pieceLetters, tolower(c));
+            if (!letter || x >= 8 || y >= 8) return false;
+            parsed.board[y * 8 + x++] = MakePieceCode((PieceType)(letter - pieceLetters), isupper(c) != 0);
+        }
+        char side = 'w';
+        char castle[8] = "-", ep[4] = "-";
+        int halfmove = 0, fullmove = 1;
+        if (sscanf(fen.c_str() + i, " %c %7s %3s %d %d", &side, castle, ep, &halfmove, &fullmove) < 1) return false;
+        parsed.whiteToMove = side != 'b';
+        for (const char* c = castle; *c; c++) {
+            if (*c == 'K') parsed.castling |= WHITE_KINGSIDE;
+            else if (*c == 'Q') parsed.castling |= WHITE_QUEENSIDE;
+            else if (*c == 'k') parsed.castling |= BLACK_KINGSIDE;
+            else if (*c == 'q') parsed.castling |= BLACK_QUEENSIDE;
+        }
+        // An en passant square is kept only behind an enemy pawn that could just have double-stepped.
+        if (ep[0] >= 'a' && ep[0] <= 'h' && ep[1] == (parsed.whiteToMove ? '6' : '3')) {
+            int sq = ('8' - ep[1]) * 8 + (ep[0] - 'a');
+            if (!parsed.board[sq] && parsed.board[sq + (parsed.whiteToMove ? 8 : -8)] == MakePieceCode(PAWN, !parsed.whiteToMove)) parsed.epSquare = (signed char)sq;
+        }
+        parsed.halfmoveClock = (uint16_t)halfmove;
+        parsed.fullmoveNumber = (uint16_t)max(fullmove, 1);
+        // Reject boards move generation cannot handle: pawns on a back rank, anything but one king
+        // per side, or the side that just moved still in check.
+        int kings[2] = { 0, 0 };
+        for (int sq = 0; sq < 64; sq++) {
+            if (PieceCodeType(parsed.board[sq]) == PAWN && (sq < 8 || sq >= 56)) return false;
+            if (PieceCodeType(parsed.board[sq]) == KING) kings[PieceCodeWhite(parsed.board[sq])]++;
+        }
+        if (kings[0] != 1 || kings[1] != 1) return false;
+        if (parsed.IsAttacked(parsed.KingSquare(!parsed.whiteToMove), parsed.whiteToMove)) return false;
+        *this = parsed;
+        return true;
+    }
+
+    string ToFEN() const {
+        static const char pieceLetters[] = "PRNBQK";
+        string fen;
+        for (int y = 0; y < 8; y++) {
+            int empty = 0;
+            for (int x = 0; x < 8; x++) {
+                unsigned char code = board[y * 8 + x];
+                if (!code) { empty++; continue; }
+                if (empty) fen += (char)('0' + empty);
+                empty = 0;
+                char letter = pieceLetters[PieceCodeType(code)];
+                fen += PieceCodeWhite(code) ? letter : (char)tolower(letter);
+            }
+            if (empty) fen += (char)('0' + empty);
+            if (y < 7) fen += '/';
+        }
+        fen += whiteToMove ? " w " : " b ";
+        if (castling & WHITE_KINGSIDE) fen += 'K';
+        if (castling & WHITE_QUEENSIDE) fen += 'Q';
+        if (castling & BLACK_KINGSIDE) fen += 'k';
+        if (castling & BLACK_QUEENSIDE) fen += 'q';
+        if (!castling) fen += '-';
+        fen += ' ';
+        fen += epSquare < 0 ? string("-") : SquareName(epSquare);
+        fen += " " + to_string(halfmoveClock) + " " + to_string(fullmoveNumber);
+        return fen;
+    }
+
+    static string SquareName(int sq) {
+        string name;
+        name += (char)('a' + sq % 8);
+        name += (char)('8' - sq / 8);
+        return name;
+    }
+
+    static string MoveToUci(MoveCode m) {
+        static const char promotionLetters[] = " rnbq";
+        string text = SquareName(MoveFrom(m)) + SquareName(MoveTo(m));
+        if (MovePromotion(m) != PAWN) text += promotionLetters[MovePromotion(m)];
+        return text;
+    }
+
+    // Parses coordinate notation ("e2e4", "e7e8q"); a bare promotion defaults to a queen.
+    bool ParseUci(const string& text, MoveCode& m) const {
+        if (text.size() < 4) return false;
+        for (int i = 0; i < 4; i += 2) {
+            if (text[i] < 'a' || text[i] > 'h' || text[i + 1] < '1' || text[i + 1] > '8') return false;
+        }
+        int from = ('8' - text[1]) * 8 + (text[0] - 'a');
+        int to = ('8' - text[3]) * 8 + (text[2] - 'a');
+        PieceType promotion = PAWN;
+        if (text.size() >= 5) {
+            switch (tolower(text[4])) {
+            case 'q': promotion = QUEEN; break;
+            case 'r': promotion = ROOK; break;
+            case 'b': promotion = BISHOP; break;
+            case 'n': promotion = KNIGHT; break;
+            default: return false;
+            }
+        }
+        else if (PieceCodeType(board[from]) == PAWN && (to < 8 || to >= 56)) promotion = QUEEN;
+        m = MakeMoveCode(from, to, promotion);
+        return true;
+    }
+
+    // Standard algebraic notation of a legal move, with minimal disambiguation and a check/mate suffix.
+    string MoveToSan(MoveCode m) const {
+        static const char pieceLetters[] = "PRNBQK";
+        int from = MoveFrom(m), to = MoveTo(m);
+        PieceType type = PieceCodeType(board[from]);
+        string san;
+        if (type == KING && abs(to - from) == 2) san = to > from ? "O-O" : "O-O-O";
+        else {
+            bool capture = board[to] || (type == PAWN && to == epSquare);
+            if (type == PAWN) {
+                if (capture) san += (char)('a' + from % 8);
+            }
+            else {
+                san += pieceLetters[type];
+                MoveCode moves[maxMoves];
+                int count = GenerateLegalMoves(moves);
+                bool ambiguous = false, sameFile = false, sameRank = false;
+                for (int i = 0; i < count; i++) {
+                    int other = MoveFrom(moves[i]);
+                    if (MoveTo(moves[i]) != to || other == from || PieceCodeType(board[other]) != type) continue;
+                    ambiguous = true;
+                    sameFile |= other % 8 == from % 8;
+                    sameRank |= other / 8 == from / 8;
+                }
+                if (ambiguous && (!sameFile || sameRank)) san += (char)('a' + from % 8);
+                if (ambiguous && sameFile) san += (char)('8' - from / 8);
+            }
+            if (capture) san += 'x';
+            san += SquareName(to);
+            if (MovePromotion(m) != PAWN) {
+                san += '=';
+                san += pieceLetters[MovePromotion(m)];
+            }
+        }
+        Position next = *this;
+        next.MakeMove(m);
+        if (next.InCheck()) san += next.HasLegalMove() ? '+' : '#';
+        return san;
+    }
+
+    // Parses a SAN move as found in PGN movetext ("Nbd7", "exd6", "e8=Q+", "O-O", "0-0-0"). Annotations
+    // are ignored and over-specified disambiguation is accepted; the move must be legal and unique.
+    // Only moves of the named piece type to the named square are tested for legality.
+    bool ParseSan(const string& text, MoveCode& m) const {
+        static const char pieceLetters[] = "PRNBQK";
+        string san = text;
+        while (!san.empty() && strchr("+#!?", san.back())) san.pop_back();
+        PieceType type = PAWN, promotion = PAWN;
+        int to = -1, fromFile = -1, fromRank = -1;
+        if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0") {
+            type = KING;
+            int king = KingSquare(whiteToMove);
+            to = san.size() == 3 ? king + 2 : king - 2;
+            fromFile = king % 8;
+        }
+        else {
+            size_t equals = san.find('=');
+            if (equals != string::npos || (san.size() >= 3 && strchr("QRBN", san.back()) && isdigit((unsigned char)san[san.size() - 2]))) {
+                const char* letter = strchr(pieceLetters, toupper(san.back()));
+                if (!letter) return false;
+                promotion = (PieceType)(letter - pieceLetters);
+                san.erase(equals != string::npos ? equals : san.size() - 1);
+            }
+            if (!san.empty() && strchr("RNBQK", san[0])) {
+                type = (PieceType)(strchr(pieceLetters, san[0]) - pieceLetters);
+                san.erase(0, 1);
+            }
+            san.erase(remove(san.begin(), san.end(), 'x'), san.end());
+            san.erase(remove(san.begin(), san.end(), '-'), san.end());
+            if (san.size() < 2 || san.size() > 4) return false;
+            char file = san[san.size() - 2], rank = san[san.size() - 1];
+            if (file < 'a' || file > 'h' || rank < '1' || rank > '8') return false;
+            to = ('8' - rank) * 8 + (file - 'a');
+            for (size_t i = 0; i + 2 < san.size(); i++) {
+                if (san[i] >= 'a' && san[i] <= 'h') fromFile = san[i] - 'a';
+                else if (san[i] >= '1' && san[i] <= '8') fromRank = '8' - san[i];
+                else return false;
+            }
+            if (type == PAWN && promotion == PAWN && (to < 8 || to >= 56)) promotion = QUEEN;
+        }
+        if (to < 0 || to >= 64) return false;
+        unsigned char piece = MakePieceCode(type, whiteToMove);
+        int matches = 0;
+        MoveCode moves[maxMoves];
+        for (int from = 0; from < 64; from++) {
+            if (board[from] != piece || (fromFile >= 0 && from % 8 != fromFile) || (fromRank >= 0 && from / 8 != fromRank)) continue;
+            int count = GeneratePieceMoves(from, moves);
+            for (int i = 0; i < count; i++) {
+                if (MoveTo(moves[i]) != to || MovePromotion(moves[i]) != promotion || !LeavesKingSafe(moves[i])) continue;
+                m = moves[i];
+                matches++;
+            }
+        }
+        return matches == 1;
+    }
+
+    int KingSquare(bool white) const {
+        unsigned char king = MakePieceCode(KING, white);
+        for (int sq = 0; sq < 64; sq++) {
+            if (board[sq] == king) return sq;
+        }
+        return -1;
+    }
+
+    bool IsAttacked(int sq, bool byWhite) const {
+        static const int knightSteps[8][2] = { {1,2},{2,1},{2,-1},{1,-2},{-1,-2},{-2,-1},{-2,1},{-1,2} };
+        static const int kingSteps[8][2] = { {1,0},{1,1},{0,1},{-1,1},{-1,0},{-1,-1},{0,-1},{1,-1} };
+        int x = sq % 8, y = sq / 8;
+        // White pawns attack toward y - 1, so a white attacker sits one row below the target.
+        int pawnY = byWhite ? y + 1 : y - 1;
+        if (pawnY >= 0 && pawnY < 8) {
+            for (int dx = -1; dx <= 1; dx += 2) {
+                if (x + dx >= 0 && x + dx < 8 && board[pawnY * 8 + x + dx] == MakePieceCode(PAWN, byWhite)) return true;
+            }
+        }
+        for (int i = 0; i < 8; i++) {
+            int kx = x + knightSteps[i][0], ky = y + knightSteps[i][1];
+            if (kx >= 0 && kx < 8 && ky >= 0 && ky < 8 && board[ky * 8 + kx] == MakePieceCode(KNIGHT, byWhite)) return true;
+            int gx = x + kingSteps[i][0], gy = y + kingSteps[i][1];
+            if (gx >= 0 && gx < 8 && gy >= 0 && gy < 8 && board[gy * 8 + gx] == MakePieceCode(KING, byWhite)) return true;
+        }
+        for (int i = 0; i < 8; i++) {
+            bool diagonal = kingSteps[i][0] != 0 && kingSteps[i][1] != 0;
+            unsigned char slider = MakePieceCode(diagonal ? BISHOP : ROOK, byWhite);
+            unsigned char queen = MakePieceCode(QUEEN, byWhite);
+            for (int tx = x + kingSteps[i][0], ty = y + kingSteps[i][1]; tx >= 0 && tx < 8 && ty >= 0 && ty < 8; tx += kingSteps[i][0], ty += kingSteps[i][1]) {
+                unsigned char code = board[ty * 8 + tx];
+                if (!code) continue;
+                if (code == slider || code == queen) return true;
+                break;
+            }
+        }
+        return false;
+    }
+
+    bool InCheck() const {
+        return IsAttacked(KingSquare(whiteToMove), !whiteToMove);
+    }
+
+    // Pseudo-legal moves of the piece on `from`; castling is only generated when its path is safe.
+    int GeneratePieceMoves(int from, MoveCode* moves) const {
+        static const int knightSteps[8][2] = { {1,2},{2,1},{2,-1},{1,-2},{-1,-2},{-2,-1},{-2,1},{-1,2} };
+        static const int kingSteps[8][2] = { {1,0},{1,1},{0,1},{-1,1},{-1,0},{-1,-1},{0,-1},{1,-1} };
+        unsigned char code = board[from];
+        if (!code || PieceCodeWhite(code) != whiteToMove) return 0;
+        int count = 0;
+        int x = from % 8, y = from / 8;
+        auto addTarget = [&](int tx, int ty) {
+            if (tx < 0 || tx >= 8 || ty < 0 || ty >= 8) return false;
+            unsigned char target = board[ty * 8 + tx];
+            if (target && PieceCodeWhite(target) == whiteToMove) return false;
+            moves[count++] = MakeMoveCode(from, ty * 8 + tx);
+            return target == 0;
+        };
+        switch (PieceCodeType(code)) {
+        case PAWN: {
+            int dir = whiteToMove ? -1 : 1;
+            int startY = whiteToMove ? 6 : 1;
+            int lastY = whiteToMove ? 0 : 7;
+            auto addPawnMove = [&](int to) {
+                if (to / 8 == lastY) {
+                    for (PieceType promotion : { QUEEN, ROOK, BISHOP, KNIGHT }) moves[count++] = MakeMoveCode(from, to, promotion);
+                }
+                else moves[count++] = MakeMoveCode(from, to);
+            };
+            int ahead = (y + dir) * 8 + x;
+            if (!board[ahead]) {
+                addPawnMove(ahead);
+                if (y == startY && !board[ahead + dir * 8]) moves[count++] = MakeMoveCode(from, ahead + dir * 8);
+            }
+            for (int dx = -1; dx <= 1; dx += 2) {
+                if (x + dx < 0 || x + dx >= 8) continue;
+                int to = ahead + dx;
+                if ((board[to] && PieceCodeWhite(board[to]) != whiteToMove) || to == epSquare) addPawnMove(to);
+            }
+            break;
+        }
+        case KNIGHT:
+            for (int i = 0; i < 8; i++) addTarget(x + knightSteps[i][0], y + knightSteps[i][1]);
+            break;
+        case BISHOP:
+        case ROOK:
+        case QUEEN:
+            for (int i = 0; i < 8; i++) {
+                bool diagonal = kingSteps[i][0] != 0 && kingSteps[i][1] != 0;
+                if ((diagonal && PieceCodeType(code) == ROOK) || (!diagonal && PieceCodeType(code) == BISHOP)) continue;
+                for (int step = 1; addTarget(x + kingSteps[i][0] * step, y + kingSteps[i][1] * step); step++) {}
+            }
+            break;
+        case KING: {
+            for (int i = 0; i < 8; i++) addTarget(x + kingSteps[i][0], y + kingSteps[i][1]);
+            int home = whiteToMove ? 60 : 4;
+            unsigned char rights = whiteToMove ? castling & (WHITE_KINGSIDE | WHITE_QUEENSIDE) : castling & (BLACK_KINGSIDE | BLACK_QUEENSIDE);
+            if (from != home || !rights || IsAttacked(home, !whiteToMove)) break;
+            if ((rights & (WHITE_KINGSIDE | BLACK_KINGSIDE)) && !board[home + 1] && !board[home + 2] &&
+                board[home + 3] == MakePieceCode(ROOK, whiteToMove) &&
+                !IsAttacked(home + 1, !whiteToMove) && !IsAttacked(home + 2, !whiteToMove)) {
+                moves[count++] = MakeMoveCode(from, home + 2);
+            }
+            if ((rights & (WHITE_QUEENSIDE | BLACK_QUEENSIDE)) && !board[home - 1] && !board[home - 2] && !board[home - 3] &&
+                board[home - 4] == MakePieceCode(ROOK, whiteToMove) &&
+                !IsAttacked(home - 1, !whiteToMove) && !IsAttacked(home - 2, !whiteToMove)) {
+                moves[count++] = MakeMoveCode(from, home - 2);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        return count;
+    }
+
+    void MakeMove(MoveCode m) {
+        int from = MoveFrom(m), to = MoveTo(m);
+        unsigned char code = board[from];
+        PieceType type = PieceCodeType(code);
+        bool capture = board[to] != 0;
+        if (type == PAWN && to == epSquare) {
+            board[to + (whiteToMove ? 8 : -8)] = 0;
+            capture = true;
+        }
+        if (type == KING && abs(to - from) == 2) {
+            int rookFrom = to > from ? from + 3 : from - 4;
+            int rookTo = to > from ? from + 1 : from - 1;
+            board[rookTo] = board[rookFrom];
+            board[rookFrom] = 0;
+        }
+        board[to] = MovePromotion(m) != PAWN ? MakePieceCode(MovePromotion(m), whiteToMove) : code;
+        board[from] = 0;
+        epSquare = (type == PAWN && abs(to - from) == 16) ? (signed char)((from + to) / 2) : -1;
+        if (type == KING) castling &= whiteToMove ? ~(WHITE_KINGSIDE | WHITE_QUEENSIDE) : ~(BLACK_KINGSIDE | BLACK_QUEENSIDE);
+        if (from == 63 || to == 63) castling &= ~WHITE_KINGSIDE;
+        if (from == 56 || to == 56) castling &= ~WHITE_QUEENSIDE;
+        if (from == 7 || to == 7) castling &= ~BLACK_KINGSIDE;
+        if (from == 0 || to == 0) castling &= ~BLACK_QUEENSIDE;
+        halfmoveClock = (type == PAWN || capture) ? 0 : halfmoveClock + 1;
+        if (!whiteToMove) fullmoveNumber++;
+        whiteToMove = !whiteToMove;
+    }
+
+    // Copy-make legality test: the position is small enough that copying beats an undo stack.
+    bool LeavesKingSafe(MoveCode m) const {
+        Position next = *this;
+        next.MakeMove(m);
+        return !next.IsAttacked(next.KingSquare(whiteToMove), next.whiteToMove);
+    }
+
+    int GenerateLegalMoves(MoveCode* moves) const {
+        int count = 0;
+        MoveCode pseudo[maxMoves];
+        for (int from = 0; from < 64; from++) {
+            int n = GeneratePieceMoves(from, pseudo);
+            for (int i = 0; i < n; i++) {
+                if (LeavesKingSafe(pseudo[i])) moves[count++] = pseudo[i];
+            }
+        }
+        return count;
+    }
+
+    bool IsLegal(MoveCode m) const {
+        MoveCode pseudo[32];
+        int n = GeneratePieceMoves(MoveFrom(m), pseudo);
+        for (int i = 0; i < n; i++) {
+            if (pseudo[i] == m) return LeavesKingSafe(m);
+        }
+        return false;
+    }
+
+    // Bitmask of the side to move's pieces pinned against its own king.
+    uint64_t PinnedPieces() const {
+        static const int directions[8][2] = { {1,0},{1,1},{0,1},{-1,1},{-1,0},{-1,-1},{0,-1},{1,-1} };
+        int king = KingSquare(whiteToMove);
+        uint64_t pinned = 0;
+        for (int i = 0; i < 8; i++) {
+            bool diagonal = directions[i][0] != 0 && directions[i][1] != 0;
+            int blocker = -1;
+            for (int x = king % 8 + directions[i][0], y = king / 8 + directions[i][1]; x >= 0 && x < 8 && y >= 0 && y < 8; x += directions[i][0], y += directions[i][1]) {
+                unsigned char code = board[y * 8 + x];
+                if (!code) continue;
+                if (PieceCodeWhite(code) == whiteToMove) {
+                    if (blocker >= 0) break;
+                    blocker = y * 8 + x;
+                    continue;
+                }
+                PieceType type = PieceCodeType(code);
+                if (blocker >= 0 && (type == QUEEN || type == (diagonal ? BISHOP : ROOK))) pinned |= 1ull << blocker;
+                break;
+            }
+        }
+        return pinned;
+    }
+
+    bool IsCapture(MoveCode m) const {
+        return board[MoveTo(m)] != 0 || (MoveTo(m) == epSquare && PieceCodeType(board[MoveFrom(m)]) == PAWN);
+    }
+
+    // Captures and promotions, for quiescence search.
+    int GenerateLegalCaptures(MoveCode* moves) const {
+        int count = 0;
+        MoveCode pseudo[maxMoves];
+        for (int from = 0; from < 64; from++) {
+            int n = GeneratePieceMoves(from, pseudo);
+            for (int i = 0; i < n; i++) {
+                if ((IsCapture(pseudo[i]) || MovePromotion(pseudo[i]) != PAWN) && LeavesKingSafe(pseudo[i])) moves[count++] = pseudo[i];
+            }
+        }
+        return count;
+    }
+
+    // Everything GenerateLegalCaptures leaves out, so a search can generate the two sets separately.
+    int GenerateLegalQuiets(MoveCode* moves) const {
+        int count = 0;
+        MoveCode pseudo[maxMoves];
+        for (int from = 0; from < 64; from++) {
+            int n = GeneratePieceMoves(from, pseudo);
+            for (int i = 0; i < n; i++) {
+                if (!IsCapture(pseudo[i]) && MovePromotion(pseudo[i]) == PAWN && LeavesKingSafe(pseudo[i])) moves[count++] = pseudo[i];
+            }
+        }
+        return count;
+    }
+
+    // Square of the cheapest piece of the given colour attacking `sq`, or -1. Pins are ignored.
+    int LeastValuableAttacker(int sq, bool byWhite) const {
+        static const int knightSteps[8][2] = { {1,2},{2,1},{2,-1},{1,-2},{-1,-2},{-2,-1},{-2,1},{-1,2} };
+        static const int kingSteps[8][2] = { {1,0},{1,1},{0,1},{-1,1},{-1,0},{-1,-1},{0,-1},{1,-1} };
+        int best = -1, bestRank = 6;
+        auto consider = [&](int from) {
+            int rank = attackerRank[PieceCodeType(board[from])];
+            if (rank < bestRank) { best = from; bestRank = rank; }
+        };
+        int x = sq % 8, y = sq / 8;
+        int pawnY = byWhite ? y + 1 : y - 1;
+        if (pawnY >= 0 && pawnY < 8) {
+            for (int dx = -1; dx <= 1; dx += 2) {
+                if (x + dx >= 0 && x + dx < 8 && board[pawnY * 8 + x + dx] == MakePieceCode(PAWN, byWhite)) return pawnY * 8 + x + dx;
+            }
+        }
+        for (int i = 0; i < 8; i++) {
+            int kx = x + knightSteps[i][0], ky = y + knightSteps[i][1];
+            if (kx >= 0 && kx < 8 && ky >= 0 && ky < 8 && board[ky * 8 + kx] == MakePieceCode(KNIGHT, byWhite)) return ky * 8 + kx;
+        }
+        for (int i = 0; i < 8; i++) {
+            bool diagonal = kingSteps[i][0] != 0 && kingSteps[i][1] != 0;
+            for (int step = 1;; step++) {
+                int tx = x + kingSteps[i][0] * step, ty = y + kingSteps[i][1] * step;
+                if (tx < 0 || tx >= 8 || ty < 0 || ty >= 8) break;
+                unsigned char code = board[ty * 8 + tx];
+                if (!code) continue;
+                PieceType type = PieceCodeType(code);
+                if (PieceCodeWhite(code) == byWhite && (type == QUEEN || type == (diagonal ? BISHOP : ROOK) || (type == KING && step == 1))) consider(ty * 8 + tx);
+                break;
+            }
+        }
+        return best;
+    }
+
+    // Static exchange evaluation: the material balance of the capture sequence on the target square
+    // when both sides always recapture with their cheapest piece and may stop when behind.
+    int StaticExchange(MoveCode m) const {
+        int to = MoveTo(m);
+        int gain[32];
+        Position exchange = *this;
+        PieceType mover = PieceCodeType(board[MoveFrom(m)]);
+        bool enPassant = mover == PAWN && to == epSquare;
+        gain[0] = pieceValue[PieceCodeType(board[to])];
+        int onSquare = pieceValue[mover];
+        if (MovePromotion(m) != PAWN) {
+            gain[0] += pieceValue[MovePromotion(m)] - pieceValue[PAWN];
+            onSquare = pieceValue[MovePromotion(m)];
+        }
+        if (enPassant) exchange.board[to + (whiteToMove ? 8 : -8)] = 0;
+        exchange.board[to] = MovePromotion(m) != PAWN ? MakePieceCode(MovePromotion(m), whiteToMove) : board[MoveFrom(m)];
+        exchange.board[MoveFrom(m)] = 0;
+        bool side = !whiteToMove;
+        int depth = 0;
+        while (depth < 31) {
+            int from = exchange.LeastValuableAttacker(to, side);
+            if (from < 0) break;
+            // A king may only recapture when the square is no longer defended.
+            if (PieceCodeType(exchange.board[from]) == KING && exchange.LeastValuableAttacker(to, !side) >= 0) break;
+            depth++;
+            gain[depth] = onSquare - gain[depth - 1];
+            onSquare = pieceValue[PieceCodeType(exchange.board[from])];
+            exchange.board[to] = exchange.board[from];
+            exchange.board[from] = 0;
+            side = !side;
+        }
+        while (depth > 0) {
+            gain[depth - 1] = -max(-gain[depth - 1], gain[depth]);
+            depth--;
+        }
+        return gain[0];
+    }
+
+    bool HasLegalMove() const {
+        MoveCode pseudo[32];
+        for (int from = 0; from < 64; from++) {
+            int n = GeneratePieceMoves(from, pseudo);
+            for (int i = 0; i < n; i++) {
+                if (LeavesKingSafe(pseudo[i])) return true;
+            }
+        }
+        return false;
+    }
+
+    // The en passant square only distinguishes positions when a capture onto it is possible.
+    bool CanCaptureEnPassant() const {
+        if (epSquare < 0) return false;
+        int x = epSquare % 8, y = epSquare / 8 + (whiteToMove ? 1 : -1);
+        unsigned char pawn = MakePieceCode(PAWN, whiteToMove);
+        return (x > 0 && board[y * 8 + x - 1] == pawn) || (x < 7 && board[y * 8 + x + 1] == pawn);
+    }
+
+    uint64_t Key() const {
+        uint64_t key = zobrist.castling[castling];
+        for (int sq = 0; sq < 64; sq++) {
+            if (board[sq]) key ^= zobrist.piece[board[sq]][sq];
+        }
+        if (CanCaptureEnPassant()) key ^= zobrist.epFile[epSquare % 8];
+        if (!whiteToMove) key ^= zobrist.blackToMove;
+        return key;
+    }
+
+    // King versus king with at most one minor piece, or bishops that all stand on one square colour.
+    bool HasInsufficientMaterial() const {
+        int minors = 0, knights = 0, bishopColors = 0;
+        for (int sq = 0; sq < 64; sq++) {
+            switch (PieceCodeType(board[sq])) {
+            case PAWN: case ROOK: case QUEEN: return false;
+            case KNIGHT: minors++; knights++; break;
+            case BISHOP: minors++; bishopColors |= 1 << ((sq % 8 + sq / 8) % 2); break;
+            default: break;
+            }
+        }
+        return minors <= 1 || (knights == 0 && bishopColors != 3);
+    }
+};
+
+// Check, mate, stalemate and draw state of a position, derived from one legal-move generation
+// pass. It is computed once per move and read by the game screen, the server and the tools.
+struct GameStatus {
+    PlayStatus result = PLAY_ONGOING;
+    bool inCheck = false;
+    int legalMoveCount = 0;
+    MoveCode legalMoves[maxMoves];
+
+    // `keys` holds the Zobrist keys of the game's positions so far, the current one last, and may be
+    // empty when repetition does not matter. With listMoves false, generation stops at the first
+    // legal move and legalMoveCount is only 0 or 1.
+    void Compute(const Position& position, const uint64_t* keys = nullptr, int keyCount = 0, bool listMoves = true) {
+        inCheck = position.InCheck();
+        legalMoveCount = listMoves ? position.GenerateLegalMoves(legalMoves) : (position.HasLegalMove() ? 1 : 0);
+        if (legalMoveCount == 0) result = inCheck ? PLAY_CHECKMATE : PLAY_STALEMATE;
+        else if (position.HasInsufficientMaterial()) result = PLAY_DRAW_MATERIAL;
+        else if (position.halfmoveClock >= 100) result = PLAY_DRAW_FIFTY;
+        else if (IsThreefold(position, keys, keyCount)) result = PLAY_DRAW_REPETITION;
+        else result = inCheck ? PLAY_CHECK : PLAY_ONGOING;
+    }
+
+    static bool IsThreefold(const Position& position, const uint64_t* keys, int keyCount) {
+        if (keyCount < 5) return false;
+        int occurrences = 1;
+        int oldest = max(0, keyCount - 1 - (int)position.halfmoveClock);
+        for (int i = keyCount - 3; i >= oldest; i -= 2) {
+            if (keys[i] == keys[keyCount - 1] && ++occurrences >= 3) return true;
+        }
+        return false;
+    }
+
+    bool IsOver() const { return result >= PLAY_CHECKMATE; }
+    bool IsDraw() const { return result >= PLAY_STALEMATE; }
+
+    bool Allows(MoveCode m) const {
+        return find(legalMoves, legalMoves + legalMoveCount, m) != legalMoves + legalMoveCount;
+    }
+
+    const char* Name() const { return ResultName(result); }
+
+    static const char* ResultName(PlayStatus status) {
+        switch (status) {
+        case PLAY_CHECK: return "check";
+        case PLAY_CHECKMATE: return "checkmate";
+        case PLAY_STALEMATE: return "stalemate";
+        case PLAY_DRAW_FIFTY: return "draw-fifty";
+        case PLAY_DRAW_REPETITION: return "draw-repetition";
+        case PLAY_DRAW_MATERIAL: return "draw-material";
+        default: return "ongoing";
+        }
+    }
+};
+
+// Batched (position, move) validation for high-volume checking. Inputs and outputs are kept as
+// parallel arrays; each candidate move refers to a position by index so shared positions are
+// stored once. A candidate whose position index is out of range is reported illegal.
+struct MoveBatch {
+    vector<Position> positions;
+    vector<uint32_t> positionIndex;
+    vector<MoveCode> moves;
+    vector<uint8_t> legal;  // output: 1 if the move is legal
+    vector<uint8_t> status; // output: PlayStatus after the move (PLAY_ONGOING when illegal)
+
+    size_t Size() const { return moves.size(); }
+
+    void Add(uint32_t position, MoveCode move) {
+        positionIndex.push_back(position);
+        moves.push_back(move);
+    }
+};
+
+// Validates candidates order[0..count) whose positions are grouped together. Check and pin state
+// is computed once per position; when the king is safe and the piece is neither the king nor
+// pinned, a pseudo-legal move is legal without the copy-make test.
+void ValidateMoveRange(const MoveBatch& batch, const uint32_t* order, size_t count, uint8_t* legal, uint8_t* status) {
+    MoveCode pieceMoves[32];
+    GameStatus after;
+    size_t groupStart = 0;
+    while (groupStart < count) {
+        uint32_t positionIndex = batch.positionIndex[order[groupStart]];
+        size_t groupEnd = groupStart + 1;
+        while (groupEnd < count && batch.positionIndex[order[groupEnd]] == positionIndex) groupEnd++;
+        const Position& position = batch.positions[positionIndex];
+        uint64_t unsafe = position.InCheck() ? ~0ull : position.PinnedPieces();
+        unsafe |= 1ull << position.KingSquare(position.whiteToMove);
+        for (size_t i = groupStart; i < groupEnd; i++) {
+            uint32_t candidate = order[i];
+            MoveCode move = batch.moves[candidate];
+            int from = MoveFrom(move);
+            int n = position.GeneratePieceMoves(from, pieceMoves);
+            bool isLegal = find(pieceMoves, pieceMoves + n, move) != pieceMoves + n;
+            if (isLegal && (((unsafe >> from) & 1) || MoveTo(move) == position.epSquare)) isLegal = position.LeavesKingSafe(move);
+            legal[candidate] = isLegal;
+            status[candidate] = PLAY_ONGOING;
+            if (isLegal) {
+                Position next = position;
+                next.MakeMove(move);
+                after.Compute(next, nullptr, 0, false);
+                status[candidate] = (uint8_t)after.result;
+            }
+        }
+        groupStart = groupEnd;
+    }
+}
+
+void ValidateMoveBatch(MoveBatch& batch, int threadCount) {
+    size_t count = batch.Size();
+    batch.legal.assign(count, 0);
+    batch.status.assign(count, PLAY_ONGOING);
+    // Counting sort by position so every position is loaded once and stays hot in cache. Candidates
+    // with a bad position index stay out of the order and keep their illegal result.
+    size_t positionCount = batch.positions.size();
+    vector<uint32_t> offsets(positionCount + 1, 0);
+    for (size_t i = 0; i < count; i++) {
+        if (batch.positionIndex[i] < positionCount) offsets[batch.positionIndex[i] + 1]++;
+    }
+    for (size_t i = 1; i < offsets.size(); i++) offsets[i] += offsets[i - 1];
+    count = offsets[positionCount];
+    vector<uint32_t> order(count);
+    for (size_t i = 0; i < batch.Size(); i++) {
+        if (batch.positionIndex[i] < positionCount) order[offsets[batch.positionIndex[i]]++] = (uint32_t)i;
+    }
+    threadCount = max(1, min(threadCount, (int)(count / 1024) + 1));
+    vector<thread> workers;
+    size_t start = 0;
+    for (int t = 0; t < threadCount; t++) {
+        size_t end = t == threadCount - 1 ? count : count * (t + 1) / threadCount;
+        // Never split a position's group between two threads.
+        while (end > start && end < count && batch.positionIndex[order[end]] == batch.positionIndex[order[end - 1]]) end++;
+        if (end <= start) continue;
+        workers.emplace_back(ValidateMoveRange, cref(batch), order.data() + start, end - start, batch.legal.data(), batch.status.data());
+        start = end;
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+// Linear evaluation: every term is weight * feature, so the tuner can fit the weights by gradient
+// descent. Weights are centipawns from White's point of view; piece-square tables are indexed by
+// square for White and by the vertically mirrored square for Black.
+enum EvalTerm {
+    EVAL_MATERIAL = 0,               // PAWN..QUEEN
+    EVAL_PST = EVAL_MATERIAL + 5,    // [PieceType][64]
+    EVAL_BISHOP_PAIR = EVAL_PST + 6 * 64,
+    EVAL_TEMPO,
+    EVAL_TERM_COUNT
+};
+
+int evalWeights[EVAL_TERM_COUNT];
+
+void SetDefaultEvalWeights() {
+    for (int i = 0; i < 5; i++) evalWeights[EVAL_MATERIAL + i] = pieceValue[i];
+    for (int sq = 0; sq < 64; sq++) {
+        int x = sq % 8, y = sq / 8;
+        int rank = 7 - y; // 0 = White's back rank
+        int center = 6 - (abs(2 * x - 7) + abs(2 * y - 7)) / 2; // 0 in the corners, 6 in the middle
+        evalWeights[EVAL_PST + PAWN * 64 + sq] = (rank == 0 || rank == 7) ? 0 : (rank - 1) * 8 + (x >= 2 && x <= 5 && rank >= 3 ? 10 : 0);
+        evalWeights[EVAL_PST + KNIGHT * 64 + sq] = center * 8 - 20;
+        evalWeights[EVAL_PST + BISHOP * 64 + sq] = center * 4 - 10;
+        evalWeights[EVAL_PST + ROOK * 64 + sq] = rank == 6 ? 20 : (x == 3 || x == 4 ? 5 : 0);
+        evalWeights[EVAL_PST + QUEEN * 64 + sq] = center * 2 - 5;
+        evalWeights[EVAL_PST + KING * 64 + sq] = rank == 0 ? (x <= 2 || x >= 6 ? 20 : 0) : -10 * min(rank, 4);
+    }
+    evalWeights[EVAL_BISHOP_PAIR] = 30;
+    evalWeights[EVAL_TEMPO] = 10;
+}
+
+// Sparse feature vector of a position: evaluation = sum of evalWeights[index] * coefficient.
+int ExtractEvalFeatures(const Position& position, uint16_t* index, int8_t* coefficient) {
+    int count = 0;
+    int material[2][5] = {};
+    for (int sq = 0; sq < 64; sq++) {
+        unsigned char code = position.board[sq];
+        if (!code) continue;
+        PieceType type = PieceCodeType(code);
+        bool white = PieceCodeWhite(code);
+        if (type != KING) material[white][type]++;
+        index[count] = (uint16_t)(EVAL_PST + type * 64 + (white ? sq : (7 - sq / 8) * 8 + sq % 8));
+        coefficient[count++] = white ? 1 : -1;
+    }
+    for (int type = 0; type < 5; type++) {
+        if (material[1][type] == material[0][type]) continue;
+        index[count] = (uint16_t)(EVAL_MATERIAL + type);
+        coefficient[count++] = (int8_t)(material[1][type] - material[0][type]);
+    }
+    int pairs = (material[1][BISHOP] >= 2) - (material[0][BISHOP] >= 2);
+    if (pairs) {
+        index[count] = EVAL_BISHOP_PAIR;
+        coefficient[count++] = (int8_t)pairs;
+    }
+    index[count] = EVAL_TEMPO;
+    coefficient[count++] = position.whiteToMove ? 1 : -1;
+    return count;
+}
+
+const int maxEvalFeatures = 40;
+
+// Static evaluation from the side to move's point of view.
+int Evaluate(const Position& position) {
+    uint16_t index[maxEvalFeatures];
+    int8_t coefficient[maxEvalFeatures];
+    int count = ExtractEvalFeatures(position, index, coefficient);
+    int score = 0;
+    for (int i = 0; i < count; i++) score += evalWeights[index[i]] * coefficient[i];
+    return position.whiteToMove ? score : -score;
+}
+
+bool SaveEvalWeights(const char* path, const double* weights) {
+    static const char* pstNames[6] = { "pst_pawn", "pst_rook", "pst_knight", "pst_bishop", "pst_queen", "pst_king" };
+    FILE* file = fopen(path, "w");
+    if (!file) return false;
+    fprintf(file, "# CheesyChess evaluation weights (centipawns, White's point of view)\nmaterial");
+    for (int i = 0; i < 5; i++) fprintf(file, " %.0f", weights[EVAL_MATERIAL + i]);
+    for (int type = 0; type < 6; type++) {
+        fprintf(file, "\n%s", pstNames[type]);
+        for (int sq = 0; sq < 64; sq++) fprintf(file, " %.0f", weights[EVAL_PST + type * 64 + sq]);
+    }
+    fprintf(file, "\nbishop_pair %.0f\ntempo %.0f\n", weights[EVAL_BISHOP_PAIR], weights[EVAL_TEMPO]);
+    fclose(file);
+    return true;
+}
+
+// Reads weights written by SaveEvalWeights; terms missing from the file keep their current value.
+bool LoadEvalWeights(const char* path) {
+    static const char* pstNames[6] = { "pst_pawn", "pst_rook", "pst_knight", "pst_bishop", "pst_queen", "pst_king" };
+    FILE* file = fopen(path, "r");
+    if (!file) return false;
+    char name[32];
+    while (fscanf(file, "%31s", name) == 1) {
+        string term = name;
+        int first = -1, count = 0;
+        if (term[0] == '#') {
+            int c;
+            while ((c = fgetc(file)) != EOF && c != '\n') {}
+            continue;
+        }
+        if (term == "material") { first = EVAL_MATERIAL; count = 5; }
+        else if (term == "bishop_pair") { first = EVAL_BISHOP_PAIR; count = 1; }
+        else if (term == "tempo") { first = EVAL_TEMPO; count = 1; }
+        for (int type = 0; type < 6; type++) {
+            if (term == pstNames[type]) { first = EVAL_PST + type * 64; count = 64; }
+        }
+        for (int i = 0; i < count; i++) {
+            if (fscanf(file, "%d", &evalWeights[first + i]) != 1) break;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// Capture-only search that resolves hanging material before a position is evaluated. `leaf`
+// receives the quiet position the returned score comes from.
+int Quiescence(const Position& position, int alpha, int beta, Position* leaf = nullptr) {
+    int standPat = Evaluate(position);
+    if (leaf) *leaf = position;
+    if (standPat >= beta) return standPat;
+    alpha = max(alpha, standPat);
+    MoveCode moves[maxMoves];
+    int count = position.GenerateLegalCaptures(moves);
+    // Most valuable victim first, then least valuable attacker.
+    auto order = [&](MoveCode m) {
+        return pieceValue[PieceCodeType(position.board[MoveTo(m)])] * 8 - attackerRank[PieceCodeType(position.board[MoveFrom(m)])];
+    };
+    sort(moves, moves + count, [&](MoveCode a, MoveCode b) { return order(a) > order(b); });
+    Position childLeaf;
+    for (int i = 0; i < count; i++) {
+        // Delta pruning: skip captures that cannot lift the score to alpha even with a margin.
+        int gain = pieceValue[PieceCodeType(position.board[MoveTo(moves[i])])] + (MovePromotion(moves[i]) != PAWN ? 800 : 0);
+        if (standPat + gain + 200 <= alpha) continue;
+        Position next = position;
+        next.MakeMove(moves[i]);
+        int score = -Quiescence(next, -beta, -alpha, leaf ? &childLeaf : nullptr);
+        if (score > alpha) {
+            alpha = score;
+            if (leaf) *leaf = childLeaf;
+            if (alpha >= beta) break;
+        }
+    }
+    return alpha;
+}
+
+// Staged move generation for the main search: the hash move, then captures in MVV-LVA order with
+// the losing ones (negative static exchange) held back, then the killer moves, then quiet moves
+// ordered by butterfly and continuation history, and finally the losing captures. Each stage is
+// generated only when it is reached, so a cutoff on an early move skips the rest of the work.
+class MovePicker {
+public:
+    enum Stage { STAGE_HASH, STAGE_CAPTURES_INIT, STAGE_GOOD_CAPTURES, STAGE_KILLERS, STAGE_QUIETS_INIT, STAGE_QUIETS, STAGE_BAD_CAPTURES, STAGE_DONE };
+
+    // `butterfly` is the side to move's [from][to] history; `continuation`, if not null, the
+    // [piece][to] history that follows the previous move.
+    MovePicker(const Position& position, MoveCode hashMove, const MoveCode* killers, const int (*butterfly)[64], const int16_t* continuation)
+        : position(position), hashMove(hashMove), killers(killers), butterfly(butterfly), continuation(continuation) {}
+
+    // Returns the next legal move, or 0 when every stage is exhausted.
+    MoveCode Next() {
+        switch (stage) {
+        case STAGE_HASH:
+            stage = STAGE_CAPTURES_INIT;
+            if (hashMove && position.IsLegal(hashMove)) return hashMove;
+            hashMove = 0;
+            // fall through
+        case STAGE_CAPTURES_INIT:
+            count = position.GenerateLegalCaptures(moves);
+            for (int i = 0; i < count; i++) {
+                scores[i] = pieceValue[PieceCodeType(position.board[MoveTo(moves[i])])] * 8 - attackerRank[PieceCodeType(position.board[MoveFrom(moves[i])])];
+                if (MovePromotion(moves[i]) != PAWN) scores[i] += pieceValue[MovePromotion(moves[i])] * 8;
+            }
+            index = 0;
+            stage = STAGE_GOOD_CAPTURES;
+            // fall through
+        case STAGE_GOOD_CAPTURES:
+            while (index < count) {
+                MoveCode m = PickBest();
+                if (m == hashMove) continue;
+                // Capturing something worth at least the capturer cannot lose material, so only the rest need SEE.
+                int victim = pieceValue[PieceCodeType(position.board[MoveTo(m)])], attacker = pieceValue[PieceCodeType(position.board[MoveFrom(m)])];
+                if (MovePromotion(m) == PAWN && victim < attacker && position.StaticExchange(m) < 0) {
+                    badCaptures[badCount++] = m;
+                    continue;
+                }
+                return m;
+            }
+            stage = STAGE_KILLERS;
+            // fall through
+        case STAGE_KILLERS:
+            while (killerIndex < 2) {
+                MoveCode m = killers[killerIndex++];
+                if (m && m != hashMove && !position.IsCapture(m) && MovePromotion(m) == PAWN && position.IsLegal(m)) return m;
+            }
+            stage = STAGE_QUIETS_INIT;
+            // fall through
+        case STAGE_QUIETS_INIT:
+            count = position.GenerateLegalQuiets(moves);
+            for (int i = 0; i < count; i++) {
+                int from = MoveFrom(moves[i]), to = MoveTo(moves[i]);
+                scores[i] = butterfly[from][to] + (continuation ? continuation[position.board[from] * 64 + to] : 0);
+            }
+            index = 0;
+            stage = STAGE_QUIETS;
+            // fall through
+        case STAGE_QUIETS:
+            while (index < count) {
+                MoveCode m = PickBest();
+                if (m != hashMove && m != killers[0] && m != killers[1]) return m;
+            }
+            stage = STAGE_BAD_CAPTURES;
+            // fall through
+        case STAGE_BAD_CAPTURES:
+            if (badIndex < badCount) return badCaptures[badIndex++];
+            stage = STAGE_DONE;
+            // fall through
+        default:
+            return 0;
+        }
+    }
+
+    Stage CurrentStage() const { return stage; }
+
+private:
+    const Position& position;
+    MoveCode hashMove;
+    const MoveCode* killers;
+    const int (*butterfly)[64];
+    const int16_t* continuation;
+    Stage stage = STAGE_HASH;
+    MoveCode moves[maxMoves], badCaptures[maxMoves];
+    int scores[maxMoves];
+    int count = 0, index = 0, killerIndex = 0, badCount = 0, badIndex = 0;
+
+    // Selection step: moves the best remaining move to `index`, so only the moves actually tried get sorted.
+    MoveCode PickBest() {
+        int best = index;
+        for (int i = index + 1; i < count; i++) {
+            if (scores[i] > scores[best]) best = i;
+        }
+        swap(moves[index], moves[best]);
+        swap(scores[index], scores[best]);
+        return moves[index++];
+    }
+};
+
+// Alpha-beta search over the rules core: iterative deepening, principal variation search with a
+// transposition table, check extension and quiescence at the horizon. A search runs on its own
+// thread so the game screen stays responsive and the engine can ponder on the opponent's time.
+// Multi-PV searches the root once per line, excluding the moves of the lines already found; the
+// later lines reuse the transposition table filled by the earlier ones.
+const int mateScore = 32000;
+const int maxSearchPly = 64;
+
+class Engine {
+public:
+    struct Limits {
+        int depth = maxSearchPly - 1;
+        int moveTimeMs = 0;     // 0: no time limit
+        int multiPv = 1;
+        bool ponder = false;    // untimed until PonderHit(); the move time then counts from the start
+        bool infinite = false;  // keep the result until Stop(), as UCI "go infinite" requires
+        bool legacyOrdering = false;  // sort all moves up front instead of using the staged picker
+    };
+
+    struct Line {
+        vector<MoveCode> pv;
+        int score = 0;
+    };
+
+    struct Report {
+        vector<Line> lines;  // best first
+        int depth = 0;
+        uint64_t nodes = 0;
+        double milliseconds = 0;
+        uint64_t cutoffs = 0, firstMoveCutoffs = 0;  // beta cutoffs, and those on the first move tried
+    };
+
+    // Called on the search thread after every completed depth and once when the search ends.
+    function<void(const Report&)> onIteration;
+    function<void(const Report&)> onFinish;
+
+    explicit Engine(int hashBits = 20) : table((size_t)1 << hashBits), mask(((size_t)1 << hashBits) - 1), continuationHistory(16 * 64 * 16 * 64) {
+        ClearHistory();
+    }
+
+    ~Engine() {
+        Stop();
+        Wait();
+    }
+
+    // Starts an asynchronous search; `history` holds the keys of the game so far, ending with the root.
+    void Start(const Position& position, const vector<uint64_t>& history, const Limits& searchLimits) {
+        Stop();
+        Wait();
+        root = position;
+        path = history;
+        if (path.empty() || path.back() != root.Key()) path.push_back(root.Key());
+        limits = searchLimits;
+        stopRequested = false;
+        pondering = limits.ponder;
+        finished = false;
+        startTime = Clock::now();
+        SetDeadlines(pondering ? 0 : limits.moveTimeMs);
+        {
+            lock_guard<mutex> lock(reportMutex);
+            latest = Report();
+        }
+        worker = thread(&Engine::Run, this);
+    }
+
+    Report Think(const Position& position, const vector<uint64_t>& history, const Limits& searchLimits) {
+        Start(position, history, searchLimits);
+        return Wait();
+    }
+
+    void Stop() {
+        stopRequested = true;
+        pondering = false;
+    }
+
+    // The predicted move was played: the ponder search becomes a normal timed search.
+    void PonderHit() {
+        SetDeadlines(limits.moveTimeMs);
+        pondering = false;
+    }
+
+    bool Running() const { return worker.joinable(); }
+    bool Finished() const { return finished; }
+    bool Pondering() const { return pondering; }
+    const Position& Root() const { return root; }
+
+    Report Wait() {
+        if (worker.joinable()) worker.join();
+        return Snapshot();
+    }
+
+    // Result of the deepest completed iteration; safe to call while the search runs.
+    Report Snapshot() const {
+        lock_guard<mutex> lock(reportMutex);
+        return latest;
+    }
+
+    void NewGame() {
+        Stop();
+        Wait();
+        fill(table.begin(), table.end(), Entry());
+        ClearHistory();
+    }
+
+private:
+    typedef chrono::steady_clock Clock;
+    static const int historyLimit = 16384;
+    enum Bound : uint8_t { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
+
+    struct Entry {
+        uint64_t key = 0;
+        MoveCode move = 0;
+        int16_t score = 0;
+        int8_t depth = 0;
+        Bound bound = BOUND_NONE;
+    };
+
+    vector<Entry> table;
+    size_t mask;
+    Position root;
+    vector<uint64_t> path;  // game history followed by the keys of the current search path
+    Limits limits;
+    thread worker;
+    atomic<bool> stopRequested{ false }, pondering{ false }, finished{ true };
+    atomic<int64_t> hardDeadline{ 0 }, softDeadline{ 0 };  // microseconds after startTime, 0 if untimed
+    Clock::time_point startTime;
+    bool aborted = false;
+    int rootDepth = 0;
+    uint64_t nodes = 0;
+    MoveCode pvTable[maxSearchPly][maxSearchPly];
+    int pvLength[maxSearchPly];
+    MoveCode pathMove[maxSearchPly];         // move played at each ply of the current path
+    unsigned char pathPiece[maxSearchPly];   // and the piece code that played it
+    MoveCode killers[maxSearchPly + 1][2];   // quiet moves that caused a cutoff at each ply
+    int butterflyHistory[2][64][64];         // [side][from][to]
+    vector<int16_t> continuationHistory;     // [previous piece][previous to][piece][to]
+    uint64_t cutoffs = 0, firstMoveCutoffs = 0;
+    mutable mutex reportMutex;
+    Report latest;
+
+    // Deadlines count from the start of the search, so time spent pondering is already used up.
+    void SetDeadlines(int moveTimeMs) {
+        softDeadline = moveTimeMs > 0 ? (int64_t)moveTimeMs * 500 : 0;
+        hardDeadline = moveTimeMs > 0 ? (int64_t)moveTimeMs * 1000 : 0;
+    }
+
+    int64_t ElapsedUs() const { return chrono::duration_cast<chrono::microseconds>(Clock::now() - startTime).count(); }
+
+    void CheckAbort() {
+        int64_t deadline = hardDeadline;
+        if (stopRequested || (deadline > 0 && !pondering && ElapsedUs() >= deadline)) aborted = rootDepth > 1;
+    }
+
+    bool IsRepetition() const {
+        // The current key is last; earlier occurrences with the same side to move are 2, 4, ... back.
+        int plies = (int)path.size() - 1;
+        for (int i = plies - 4; i >= 0; i -= 2) {
+            if (path[i] == path[plies]) return true;
+        }
+        return false;
+    }
+
+    static int ToTable(int score, int ply) { return score > mateScore - maxSearchPly ? score + ply : score < -mateScore + maxSearchPly ? score - ply : score; }
+    static int FromTable(int score, int ply) { return score > mateScore - maxSearchPly ? score - ply : score < -mateScore + maxSearchPly ? score + ply : score; }
+
+    void ClearHistory() {
+        memset(killers, 0, sizeof(killers));
+        memset(butterflyHistory, 0, sizeof(butterflyHistory));
+        fill(continuationHistory.begin(), continuationHistory.end(), (int16_t)0);
+    }
+
+    // History with gravity: entries move toward +-historyLimit and never leave that range.
+    static void UpdateHistory(int& entry, int bonus) { entry += bonus - entry * abs(bonus) / historyLimit; }
+
+    // A quiet move refuted the node: make it a killer and raise its history, lower the quiets tried before it.
+    void RewardQuiet(const Position& position, MoveCode move, const MoveCode* tried, int triedCount, int depth, int ply, int16_t* continuation) {
+        if (killers[ply][0] != move) {
+            killers[ply][1] = killers[ply][0];
+            killers[ply][0] = move;
+        }
+        int bonus = min(depth * depth, 400);
+        for (int i = -1; i < triedCount; i++) {
+            MoveCode m = i < 0 ? move : tried[i];
+            int delta = i < 0 ? bonus : -bonus;
+            UpdateHistory(butterflyHistory[position.whiteToMove][MoveFrom(m)][MoveTo(m)], delta);
+            if (continuation) {
+                int value = continuation[position.board[MoveFrom(m)] * 64 + MoveTo(m)];
+                UpdateHistory(value, delta);
+                continuation[position.board[MoveFrom(m)] * 64 + MoveTo(m)] = (int16_t)value;
+            }
+        }
+    }
+
+    // Legacy ordering: hash move first, then captures by most valuable victim / least valuable attacker, then quiets.
+    static void OrderMoves(const Position& position, MoveCode* moves, int count, MoveCode hashMove) {
+        int scores[maxMoves];
+        for (int i = 0; i < count; i++) {
+            MoveCode m = moves[i];
+            if (m == hashMove) scores[i] = 1 << 20;
+            else if (position.IsCapture(m) || MovePromotion(m) != PAWN) {
+                scores[i] = (1 << 16) + pieceValue[PieceCodeType(position.board[MoveTo(m)])] * 8 - attackerRank[PieceCodeType(position.board[MoveFrom(m)])];
+            }
+            else scores[i] = 0;
+        }
+        for (int i = 1; i < count; i++) {
+            for (int j = i; j > 0 && scores[j] > scores[j - 1]; j--) {
+                swap(scores[j], scores[j - 1]);
+                swap(moves[j], moves[j - 1]);
+            }
+        }
+    }
+
+    int Negamax(const Position& position, int depth, int alpha, int beta, int ply) {
+        pvLength[ply] = ply;
+        if ((++nodes & 1023) == 0) CheckAbort();
+        if (aborted) return 0;
+        bool inCheck = position.InCheck();
+        if (inCheck) depth++;
+        if (depth <= 0 || ply >= maxSearchPly - 1) return Quiescence(position, alpha, beta);
+        if (position.halfmoveClock >= 100 || IsRepetition()) return 0;
+
+        uint64_t key = path.back();
+        Entry& entry = table[key & mask];
+        MoveCode hashMove = 0;
+        if (entry.key == key) {
+            hashMove = entry.move;
+            int score = FromTable(entry.score, ply);
+            if (entry.depth >= depth && beta - alpha == 1 &&
+                (entry.bound == BOUND_EXACT || (entry.bound == BOUND_LOWER && score >= beta) || (entry.bound == BOUND_UPPER && score <= alpha))) {
+                return score;
+            }
+        }
+        // The legacy ordering generates and sorts every move up front; the staged picker generates lazily.
+        MoveCode moves[maxMoves];
+        int count = 0, cursor = 0;
+        if (limits.legacyOrdering) {
+            count = position.GenerateLegalMoves(moves);
+            OrderMoves(position, moves, count, hashMove);
+        }
+        int16_t* continuation = ply > 0 ? &continuationHistory[(pathPiece[ply - 1] * 64 + MoveTo(pathMove[ply - 1])) * 16 * 64] : nullptr;
+        MovePicker picker(position, hashMove, killers[ply], butterflyHistory[position.whiteToMove], continuation);
+        MoveCode quietsTried[maxMoves];
+        int quietCount = 0, searched = 0;
+
+        int originalAlpha = alpha, bestScore = -mateScore - 1;
+        MoveCode bestMove = 0;
+        for (MoveCode move; (move = limits.legacyOrdering ? (cursor < count ? moves[cursor++] : 0) : picker.Next()) != 0;) {
+            Position child = position;
+            child.MakeMove(move);
+            path.push_back(child.Key());
+            pathMove[ply] = move;
+            pathPiece[ply] = position.board[MoveFrom(move)];
+            bool quiet = !position.IsCapture(move) && MovePromotion(move) == PAWN;
+            int score;
+            if (searched++ == 0) score = -Negamax(child, depth - 1, -beta, -alpha, ply + 1);
+            else {
+                score = -Negamax(child, depth - 1, -alpha - 1, -alpha, ply + 1);
+                if (score > alpha && score < beta) score = -Negamax(child, depth - 1, -beta, -alpha, ply + 1);
+            }
+            path.pop_back();
+            if (aborted) return 0;
+            if (score > bestScore) {
+                bestScore = score;
+                bestMove = move;
+                if (score > alpha) {
+                    alpha = score;
+                    pvTable[ply][ply] = move;
+                    for (int j = ply + 1; j < pvLength[ply + 1]; j++) pvTable[ply][j] = pvTable[ply + 1][j];
+                    pvLength[ply] = pvLength[ply + 1];
+                    if (alpha >= beta) {
+                        cutoffs++;
+                        firstMoveCutoffs += searched == 1;
+                        if (quiet) RewardQuiet(position, move, quietsTried, quietCount, depth, ply, continuation);
+                        break;
+                    }
+                }
+            }
+            if (quiet && quietCount < maxMoves) quietsTried[quietCount++] = move;
+        }
+        if (searched == 0) return inCheck ? -mateScore + ply : 0;
+        entry.key = key;
+        entry.move = bestMove;
+        entry.score = (int16_t)ToTable(bestScore, ply);
+        entry.depth = (int8_t)depth;
+        entry.bound = bestScore >= beta ? BOUND_LOWER : bestScore <= originalAlpha ? BOUND_UPPER : BOUND_EXACT;
+        return bestScore;
+    }
+
+    // Full-window search of the root moves not in `excluded`; fills `line` with the best of them.
+    void SearchRoot(int depth, const vector<MoveCode>& excluded, Line& line) {
+        MoveCode moves[maxMoves];
+        int count = root.GenerateLegalMoves(moves);
+        Entry& entry = table[path.back() & mask];
+        OrderMoves(root, moves, count, entry.key == path.back() ? entry.move : 0);
+        int alpha = -mateScore - 1, searched = 0;
+        pvLength[0] = 0;
+        for (int i = 0; i < count; i++) {
+            if (find(excluded.begin(), excluded.end(), moves[i]) != excluded.end()) continue;
+            Position child = root;
+            child.MakeMove(moves[i]);
+            path.push_back(child.Key());
+            pathMove[0] = moves[i];
+            pathPiece[0] = root.board[MoveFrom(moves[i])];
+            int score;
+            if (searched++ == 0) score = -Negamax(child, depth - 1, -mateScore - 1, -alpha, 1);
+            else {
+                score = -Negamax(child, depth - 1, -alpha - 1, -alpha, 1);
+                if (score > alpha) score = -Negamax(child, depth - 1, -mateScore - 1, -alpha, 1);
+            }
+            path.pop_back();
+            if (aborted) return;
+            if (score > alpha) {
+                alpha = score;
+                pvTable[0][0] = moves[i];
+                for (int j = 1; j < pvLength[1]; j++) pvTable[0][j] = pvTable[1][j];
+                pvLength[0] = max(pvLength[1], 1);
+            }
+        }
+        line.score = alpha;
+        line.pv.assign(pvTable[0], pvTable[0] + pvLength[0]);
+        if (excluded.empty()) {
+            entry.key = path.back();
+            entry.move = line.pv[0];
+            entry.score = (int16_t)ToTable(alpha, 0);
+            entry.depth = (int8_t)depth;
+            entry.bound = BOUND_EXACT;
+        }
+    }
+
+    void Run() {
+        nodes = 0;
+        cutoffs = firstMoveCutoffs = 0;
+        memset(killers, 0, sizeof(killers));
+        aborted = false;
+        MoveCode moves[maxMoves];
+        int multiPv = min(max(limits.multiPv, 1), root.GenerateLegalMoves(moves));
+        for (rootDepth = 1; multiPv > 0 && rootDepth <= limits.depth; rootDepth++) {
+            vector<Line> lines;
+            vector<MoveCode> excluded;
+            for (int i = 0; i < multiPv && !aborted; i++) {
+                Line line;
+                SearchRoot(rootDepth, excluded, line);
+                if (aborted) break;
+                excluded.push_back(line.pv[0]);
+                lines.push_back(line);
+            }
+            if (aborted) break;
+            stable_sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) { return a.score > b.score; });
+            Report report;
+            report.lines = lines;
+            report.depth = rootDepth;
+            report.nodes = nodes;
+            report.milliseconds = ElapsedUs() / 1000.0;
+            report.cutoffs = cutoffs;
+            report.firstMoveCutoffs = firstMoveCutoffs;
+            {
+                lock_guard<mutex> lock(reportMutex);
+                latest = report;
+            }
+            if (onIteration) onIteration(report);
+            int64_t soft = softDeadline;
+            if (stopRequested || (!pondering && soft > 0 && ElapsedUs() >= soft)) break;
+            if (!pondering && !limits.infinite && lines[0].score >= mateScore - rootDepth) break;
+        }
+        while ((pondering || limits.infinite) && !stopRequested) this_thread::sleep_for(chrono::milliseconds(1));
+        Report report = Snapshot();
+        report.nodes = nodes;
+        report.milliseconds = ElapsedUs() / 1000.0;
+        {
+            lock_guard<mutex> lock(reportMutex);
+            latest = report;
+        }
+        if (onFinish) onFinish(report);
+        finished = true;
+    }
+};
+
+// "cp 35" or "mate 3" (negative when the side to move is being mated), as UCI reports scores.
+string FormatSearchScore(int score) {
+    if (abs(score) >= mateScore - maxSearchPly) {
+        int plies = mateScore - abs(score);
+        return "mate " + to_string(score > 0 ? (plies + 1) / 2 : -(plies / 2));
+    }
+    return "cp " + to_string(score);
+}
+
+// Depth-first proof-number search for forced mates. The attacker (side to move at the root) tries
+// checking moves only and the defender all evasions; a node proves the mate when pn reaches 0 and
+// disproves it when dn does. A checks-only disproof does not rule out mates with quiet moves, so
+// callers that need a sound "no mate" re-run with checksOnly off. Entries are keyed by position and
+// remaining plies, so the depth bound also keeps repetitions from cycling.
+class MateSolver {
+public:
+    enum Result { MATE_FOUND, NO_MATE, UNKNOWN };
+
+    explicit MateSolver(int hashBits = 20) : table((size_t)1 << hashBits), mask(((size_t)1 << hashBits) - 1) {}
+
+    // Searches for a mate in at most `mateIn` moves. On success `line` holds the forced sequence.
+    Result Solve(const Position& root, int mateIn, uint64_t nodeLimit, vector<MoveCode>& line, bool checksOnly = true) {
+        // Bumping the generation invalidates the previous puzzle's entries without clearing the table.
+        if (++generation == 0) {
+            fill(table.begin(), table.end(), Entry());
+            generation = 1;
+        }
+        nodes = 0;
+        onlyChecks = checksOnly;
+        limit = nodeLimit;
+        attackerWhite = root.whiteToMove;
+        int depth = 2 * mateIn - 1;
+        Search(root, root.Key(), depth, infinity, infinity);
+        Entry rootEntry = Lookup(root.Key(), depth);
+        line.clear();
+        if (rootEntry.pn != 0) return rootEntry.dn == 0 ? NO_MATE : UNKNOWN;
+        BuildLine(root, depth, line);
+        return MATE_FOUND;
+    }
+
+    uint64_t Nodes() const { return nodes; }
+
+private:
+    static const uint32_t infinity = 100000000;
+
+    struct Entry {
+        uint64_t key = 0;
+        uint32_t pn = 1, dn = 1;
+        uint32_t work = 0;
+        int8_t depth = -1;
+        uint16_t generation = 0;
+    };
+
+    struct Child {
+        Position position;
+        uint64_t key;
+        MoveCode move;
+    };
+
+    vector<Entry> table;
+    size_t mask;
+    uint64_t nodes = 0, limit = 0;
+    bool attackerWhite = true;
+    bool onlyChecks = true;
+    uint16_t generation = 0;
+
+    static uint32_t Saturate(uint64_t value) { return value >= infinity ? infinity : (uint32_t)value; }
+
+    Entry Lookup(uint64_t key, int depth) const {
+        size_t bucket = key & mask & ~(size_t)3;
+        for (size_t i = bucket; i < bucket + 4; i++) {
+            if (table[i].key == key && table[i].depth == depth && table[i].generation == generation) return table[i];
+        }
+        return Entry();
+    }
+
+    // Four-way buckets; the entry with the least search effort behind it is replaced first.
+    void Store(uint64_t key, int depth, uint32_t pn, uint32_t dn, uint32_t work) {
+        size_t bucket = key & mask & ~(size_t)3;
+        size_t victim = bucket;
+        for (size_t i = bucket; i < bucket + 4; i++) {
+            if (table[i].key == key && table[i].depth == depth && table[i].generation == generation) { victim = i; break; }
+            if (table[i].generation != generation) victim = i;
+            else if (table[victim].generation == generation && table[i].work < table[victim].work) victim = i;
+        }
+        Entry& entry = table[victim];
+        entry.key = key;
+        entry.depth = (int8_t)depth;
+        entry.pn = pn;
+        entry.dn = dn;
+        entry.work = work;
+        entry.generation = generation;
+    }
+
+    int GenerateChildren(const Position& position, bool attacker, vector<Child>& children) const {
+        MoveCode moves[maxMoves];
+        int count = position.GenerateLegalMoves(moves);
+        children.clear();
+        for (int i = 0; i < count; i++) {
+            Child child;
+            child.position = position;
+            child.position.MakeMove(moves[i]);
+            if (attacker && onlyChecks && !child.position.InCheck()) continue;
+            child.key = child.position.Key();
+            child.move = moves[i];
+            children.push_back(child);
+        }
+        return count;
+    }
+
+    void Search(const Position& position, uint64_t key, int depth, uint32_t thresholdPn, uint32_t thresholdDn) {
+        nodes++;
+        uint64_t startNodes = nodes;
+        bool attacker = position.whiteToMove == attackerWhite;
+        vector<Child> children;
+        int legalCount = GenerateChildren(position, attacker, children);
+        if (legalCount == 0) {
+            // No legal moves: mate if the defender is in check, otherwise stalemate.
+            bool mated = !attacker && position.InCheck();
+            Store(key, depth, mated ? 0 : infinity, mated ? infinity : 0, 1);
+            return;
+        }
+        if (children.empty() || depth <= 0) {
+            Store(key, depth, infinity, 0, 1);
+            return;
+        }
+        for (;;) {
+            uint64_t sumPn = 0, sumDn = 0;
+            uint32_t minPn = infinity, minDn = infinity, secondPn = infinity, secondDn = infinity;
+            size_t best = 0;
+            for (size_t i = 0; i < children.size(); i++) {
+                Entry child = Lookup(children[i].key, depth - 1);
+                sumPn += child.pn;
+                sumDn += child.dn;
+                uint32_t primary = attacker ? child.pn : child.dn;
+                uint32_t& minimum = attacker ? minPn : minDn;
+                uint32_t& second = attacker ? secondPn : secondDn;
+                if (primary < minimum) {
+                    second = minimum;
+                    minimum = primary;
+                    best = i;
+                }
+                else if (primary < second) second = primary;
+            }
+            uint32_t pn = attacker ? minPn : Saturate(sumPn);
+            uint32_t dn = attacker ? Saturate(sumDn) : minDn;
+            if (pn >= thresholdPn || dn >= thresholdDn || nodes >= limit) {
+                Store(key, depth, pn, dn, Saturate(nodes - startNodes + 1));
+                return;
+            }
+            Entry bestEntry = Lookup(children[best].key, depth - 1);
+            uint32_t childPn, childDn;
+            if (attacker) {
+                childPn = min(thresholdPn, Saturate((uint64_t)secondPn + 1));
+                childDn = Saturate((uint64_t)thresholdDn - dn + bestEntry.dn);
+            }
+            else {
+                childDn = min(thresholdDn, Saturate((uint64_t)secondDn + 1));
+                childPn = Saturate((uint64_t)thresholdPn - pn + bestEntry.pn);
+            }
+            Search(children[best].position, children[best].key, depth - 1, childPn, childDn);
+        }
+    }
+
+    // Follows proven attacker moves; the defender picks the evasion that took the most work to refute.
+    void BuildLine(Position position, int depth, vector<MoveCode>& line) {
+        vector<Child> children;
+        for (; depth >= 0; depth--) {
+            bool attacker = position.whiteToMove == attackerWhite;
+            GenerateChildren(position, attacker, children);
+            if (children.empty()) return;
+            const Child* next = nullptr;
+            uint32_t mostWork = 0;
+            for (const Child& child : children) {
+                Entry entry = Lookup(child.key, depth - 1);
+                if (entry.depth < 0 && depth > 0) {
+                    Search(child.position, child.key, depth - 1, infinity, infinity);
+                    entry = Lookup(child.key, depth - 1);
+                }
+                if (entry.pn != 0) continue;
+                if (attacker) { next = &child; break; }
+                if (!next || entry.work > mostWork) { next = &child; mostWork = entry.work; }
+            }
+            if (!next) return;
+            line.push_back(next->move);
+            position = next->position;
+        }
+    }
+};
+
+// Opening explorer index: one entry per (position key, next move) with the results of the games
+// that played it, sorted by key and move. The file is memory-mapped where available; a sparse
+// fence of every fenceStride-th key stays in memory, so a lookup is one small binary search over
+// the fence plus one over a single stride of entries.
+struct ExplorerEntry {
+    uint64_t key;
+    uint32_t games, whiteWins, draws;
+    MoveCode move;
+    uint16_t reserved;
+};
+
+struct ExplorerIndexHeader {
+    char magic[8];  // "CHEESYIX"
+    uint64_t entryCount;
+    uint32_t plyLimit;
+    uint32_t fenceStride;
+};
+
+struct ExplorerMove {
+    MoveCode move;
+    uint32_t games, whiteWins, draws;
+};
+
+class GameDatabase {
+public:
+    static const uint32_t fenceStride = 64;
+
+    ~GameDatabase() { Close(); }
+
+    // Opens an index written by --build-db; the fence keys follow the entries in the file. An index
+    // with no entries opens successfully and every lookup misses.
+    bool Open(const string& path) {
+        Close();
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) return false;
+        ExplorerIndexHeader header;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "CHEESYIX", 8) == 0 && header.fenceStride == fenceStride;
+        size_t entryCount = valid ? (size_t)header.entryCount : 0;
+        size_t fenceCount = (entryCount + fenceStride - 1) / fenceStride;
+#ifdef __linux__
+        // fseeko takes a 64-bit offset, so indexes past 2 GB still open.
+        if (valid) valid = fseeko(file, (off_t)(sizeof(header) + entryCount * sizeof(ExplorerEntry)), SEEK_SET) == 0;
+#else
+        // Without a mapping the entries are read anyway, so the file is read front to back without seeking.
+        if (valid) {
+            storage.resize(entryCount);
+            valid = fread(storage.data(), sizeof(ExplorerEntry), entryCount, file) == entryCount;
+            if (entryCount) entries = storage.data();
+        }
+#endif
+        if (valid) {
+            fences.resize(fenceCount);
+            valid = fread(fences.data(), sizeof(uint64_t), fenceCount, file) == fenceCount;
+        }
+        fclose(file);
+#ifdef __linux__
+        if (valid && entryCount) {
+            int fd = open(path.c_str(), O_RDONLY);
+            mappingSize = sizeof(header) + entryCount * sizeof(ExplorerEntry);
+            mapping = fd >= 0 ? mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+            if (fd >= 0) close(fd);
+            valid = mapping != MAP_FAILED;
+            if (valid) {
+                madvise(mapping, mappingSize, MADV_RANDOM);
+                entries = (const ExplorerEntry*)((const char*)mapping + sizeof(header));
+            }
+            else mapping = nullptr;
+        }
+#endif
+        if (!valid) {
+            Close();
+            return false;
+        }
+        count = entryCount;
+        plyLimit = (int)header.plyLimit;
+        opened = true;
+        return true;
+    }
+
+    void Close() {
+#ifdef __linux__
+        if (mapping) munmap(mapping, mappingSize);
+        mapping = nullptr;
+#else
+        storage.clear();
+#endif
+        entries = nullptr;
+        count = 0;
+        opened = false;
+        fences.clear();
+    }
+
+    bool IsOpen() const { return opened; }
+    size_t EntryCount() const { return count; }
+    int PlyLimit() const { return plyLimit; }
+
+    // Fills `moves` with the moves played from the position, most played first, and returns the
+    // number of games that continued from it.
+    uint32_t Lookup(uint64_t key, vector<ExplorerMove>& moves) const {
+        moves.clear();
+        if (!count) return 0;
+        // Entries with this key start after the last fence below it and no later than the first fence at or above it.
+        size_t fence = lower_bound(fences.begin(), fences.end(), key) - fences.begin();
+        size_t begin = fence ? (fence - 1) * fenceStride : 0;
+        size_t end = min(fence * fenceStride + 1, count);
+        const ExplorerEntry* entry = lower_bound(entries + begin, entries + end, key,
+            [](const ExplorerEntry& e, uint64_t k) { return e.key < k; });
+        uint32_t total = 0;
+        for (; entry < entries + count && entry->key == key; entry++) {
+            moves.push_back({ entry->move, entry->games, entry->whiteWins, entry->draws });
+            total += entry->games;
+        }
+        sort(moves.begin(), moves.end(), [](const ExplorerMove& a, const ExplorerMove& b) { return a.games > b.games; });
+        return total;
+    }
+
+private:
+    const ExplorerEntry* entries = nullptr;
+    size_t count = 0;
+    int plyLimit = 0;
+    bool opened = false;
+    vector<uint64_t> fences;
+#ifdef __linux__
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+#else
+    vector<ExplorerEntry> storage;
+#endif
+};
+
+GameDatabase explorer;
+
 class Achievement {
 public:
-    string name;
-    string description;
-    bool unlocked = false;
-    Achievement(string n, string d) : name(n), description(d) {}
+    string name;
+    string description;
+    bool unlocked = false;
+    Achievement(string n, string d) : name(n), description(d) {}
+};
+
+// Per-frame input snapshot. Every screen reads mouse and keys through `input` so a session
+// can be recorded to a file and replayed deterministically for frame-time benchmarking.
+struct InputFrame {
+    float mouseX = 0.0f, mouseY = 0.0f;
+    unsigned int buttons = 0; // bit per mouse button pressed this frame
+    unsigned int keys = 0;    // bit per entry of InputDriver::trackedKeys pressed this frame
+};
+
+enum InputMode { INPUT_LIVE, INPUT_RECORD, INPUT_REPLAY };
+
+class InputDriver {
+private:
+    InputMode mode = INPUT_LIVE;
+    FILE* file = nullptr;
+    InputFrame frame;
+    bool finished = false;
+
+    static int KeyBit(int key) {
+        for (int i = 0; i < (int)(sizeof(trackedKeys) / sizeof(trackedKeys[0])); i++) {
+            if (trackedKeys[i] == key) return i;
+        }
+        return -1;
+    }
+
+public:
+    static constexpr int trackedKeys[] = { KEY_ESCAPE, KEY_F3, KEY_F4, KEY_A, KEY_C, KEY_P };
+
+    bool Open(InputMode m, const char* path) {
+        mode = m;
+        if (mode == INPUT_LIVE) return true;
+        file = fopen(path, mode == INPUT_RECORD ? "w" : "r");
+        if (!file) return false;
+        if (mode == INPUT_RECORD) fprintf(file, "CHEESYREC 1\n");
+        else {
+            char magic[16] = {};
+            int version = 0;
+            if (fscanf(file, "%15s %d", magic, &version) != 2 || string(magic) != "CHEESYREC" || version != 1) {
+                Close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Close() {
+        if (file) fclose(file);
+        file = nullptr;
+    }
+
+    void BeginFrame() {
+        if (mode == INPUT_REPLAY) {
+            InputFrame next;
+            if (fscanf(file, "%f %f %u %u", &next.mouseX, &next.mouseY, &next.buttons, &next.keys) != 4) {
+                finished = true;
+                next = InputFrame();
+                next.mouseX = frame.mouseX;
+                next.mouseY = frame.mouseY;
+            }
+            frame = next;
+            return;
+        }
+        Vector2 mouse = GetMousePosition();
+        frame = InputFrame();
+        frame.mouseX = mouse.x;
+        frame.mouseY = mouse.y;
+        if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) frame.buttons |= 1u << MOUSE_BUTTON_LEFT;
+        if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT)) frame.buttons |= 1u << MOUSE_BUTTON_RIGHT;
+        for (int i = 0; i < (int)(sizeof(trackedKeys) / sizeof(trackedKeys[0])); i++) {
+            if (IsKeyPressed(trackedKeys[i])) frame.keys |= 1u << i;
+        }
+        if (mode == INPUT_RECORD) fprintf(file, "%g %g %u %u\n", frame.mouseX, frame.mouseY, frame.buttons, frame.keys);
+    }
+
+    bool IsReplaying() const { return mode == INPUT_REPLAY; }
+    bool ReplayFinished() const { return mode == INPUT_REPLAY && finished; }
+
+    Vector2 MousePosition() const { return { frame.mouseX, frame.mouseY }; }
+    bool MouseButtonPressed(int button) const { return (frame.buttons >> button) & 1u; }
+    bool KeyPressed(int key) const {
+        int bit = KeyBit(key);
+        return bit >= 0 && ((frame.keys >> bit) & 1u);
+    }
+};
+
+constexpr int InputDriver::trackedKeys[];
+
+InputDriver input;
+
+// Profiling is compiled in for development builds and removed when NDEBUG is set.
+// Build with -DCHEESY_PROFILE=0/1 to override.
+#ifndef CHEESY_PROFILE
+#ifdef NDEBUG
+#define CHEESY_PROFILE 0
+#else
+#define CHEESY_PROFILE 1
+#endif
+#endif
+
+enum ProfileCounter { PC_STATUS_COMPUTE, PC_LEGAL_MOVES, PC_MOVE_LOOKUP, PC_COUNT };
+enum ProfileZone { PZ_FRAME, PZ_BOARD_DRAW, PZ_PIECE_DRAW, PZ_RULES, PZ_COUNT };
+
+#if CHEESY_PROFILE
+class Profiler {
+private:
+    typedef chrono::steady_clock Clock;
+    static const int historySize = 300;
+    static const size_t maxTraceEvents = 1 << 20;
+
+    struct FrameStats {
+        double zoneUs[PZ_COUNT] = {};
+        long long counters[PC_COUNT] = {};
+    };
+    struct TraceEvent {
+        ProfileZone zone;
+        double startUs, durationUs;
+    };
+
+    Clock::time_point epoch = Clock::now();
+    FrameStats current;
+    FrameStats history[historySize];
+    int historyCount = 0, historyHead = 0;
+    int zoneDepth[PZ_COUNT] = {};
+    double zoneStart[PZ_COUNT] = {};
+    vector<TraceEvent> traceEvents;
+    bool overlayVisible = false;
+    string overlayMessage;
+
+    double Percentile(ProfileZone zone, double p) const {
+        vector<double> samples;
+        for (int i = 0; i < historyCount; i++) samples.push_back(history[i].zoneUs[zone]);
+        if (samples.empty()) return 0.0;
+        size_t k = (size_t)(p * (samples.size() - 1));
+        nth_element(samples.begin(), samples.begin() + k, samples.end());
+        return samples[k];
+    }
+
+    double Average(ProfileZone zone) const {
+        double total = 0.0;
+        for (int i = 0; i < historyCount; i++) total += history[i].zoneUs[zone];
+        return historyCount ? total / historyCount : 0.0;
+    }
+
+public:
+    static const char* ZoneName(ProfileZone zone) {
+        switch (zone) {
+        case PZ_FRAME: return "Frame";
+        case PZ_BOARD_DRAW: return "Board::Draw";
+        case PZ_PIECE_DRAW: return "Pieces";
+        case PZ_RULES: return "Rules";
+        default: return "";
+        }
+    }
+
+    double NowUs() const {
+        return chrono::duration<double, micro>(Clock::now() - epoch).count();
+    }
+
+    void Count(ProfileCounter counter, long long amount = 1) { current.counters[counter] += amount; }
+
+    // Zones may nest; only the outermost scope is timed.
+    void ZoneBegin(ProfileZone zone) {
+        if (zoneDepth[zone]++ == 0) zoneStart[zone] = NowUs();
+    }
+
+    void ZoneEnd(ProfileZone zone) {
+        if (--zoneDepth[zone] != 0) return;
+        double end = NowUs();
+        current.zoneUs[zone] += end - zoneStart[zone];
+        if (traceEvents.size() < maxTraceEvents) traceEvents.push_back({ zone, zoneStart[zone], end - zoneStart[zone] });
+    }
+
+    void BeginFrame() {
+        current = FrameStats();
+        ZoneBegin(PZ_FRAME);
+    }
+
+    void EndFrame() {
+        ZoneEnd(PZ_FRAME);
+        history[historyHead] = current;
+        historyHead = (historyHead + 1) % historySize;
+        if (historyCount < historySize) historyCount++;
+    }
+
+    bool ExportChromeTrace(const char* path) const {
+        FILE* file = fopen(path, "w");
+        if (!file) return false;
+        fprintf(file, "{\"traceEvents\":[\n");
+        for (size_t i = 0; i < traceEvents.size(); i++) {
+            const TraceEvent& e = traceEvents[i];
+            fprintf(file, "{\"name\":\"%s\",\"cat\":\"cheesy\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                ZoneName(e.zone), e.startUs, e.durationUs, i + 1 < traceEvents.size() ? "," : "");
+        }
+        fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(file);
+        return true;
+    }
+
+    // F3 toggles the overlay, F4 writes the recorded session as a Chrome trace.
+    void UpdateOverlay() {
+        if (input.KeyPressed(KEY_F3)) overlayVisible = !overlayVisible;
+        if (input.KeyPressed(KEY_F4)) {
+            overlayMessage = ExportChromeTrace("cheesy_trace.json") ? "Trace saved: cheesy_trace.json" : "Trace export failed";
+        }
+    }
+
+    void DrawOverlay() const {
+        if (!overlayVisible) return;
+        const FrameStats& last = history[(historyHead + historySize - 1) % historySize];
+        int x = screenWidth - 290, y = 10;
+        DrawRectangle(x, y, 280, 190, Color{ 0, 0, 0, 180 });
+        DrawText("Performance (F3)", x + 10, y + 8, 18, YELLOW);
+        DrawText(TextFormat("Frame p50/p95/p99: %.2f/%.2f/%.2f ms", Percentile(PZ_FRAME, 0.50) / 1000.0,
+            Percentile(PZ_FRAME, 0.95) / 1000.0, Percentile(PZ_FRAME, 0.99) / 1000.0), x + 10, y + 34, 12, WHITE);
+        DrawText(TextFormat("Board: %.3f ms  Pieces: %.3f ms", Average(PZ_BOARD_DRAW) / 1000.0, Average(PZ_PIECE_DRAW) / 1000.0), x + 10, y + 54, 12, WHITE);
+        DrawText(TextFormat("Rules avg: %.3f ms  max: %.3f ms", Average(PZ_RULES) / 1000.0, Percentile(PZ_RULES, 1.0) / 1000.0), x + 10, y + 74, 12, WHITE);
+        DrawText(TextFormat("Status computations: %lld", last.counters[PC_STATUS_COMPUTE]), x + 10, y + 100, 12, LIGHTGRAY);
+        DrawText(TextFormat("Legal moves generated: %lld", last.counters[PC_LEGAL_MOVES]), x + 10, y + 118, 12, LIGHTGRAY);
+        DrawText(TextFormat("Click move lookups: %lld", last.counters[PC_MOVE_LOOKUP]), x + 10, y + 136, 12, LIGHTGRAY);
+        DrawText(overlayMessage.empty() ? "F4: export Chrome trace" : overlayMessage.c_str(), x + 10, y + 164, 12, GRAY);
+    }
+};
+
+Profiler profiler;
+
+class ProfileScope {
+private:
+    ProfileZone zone;
+
+public:
+    ProfileScope(ProfileZone z) : zone(z) { profiler.ZoneBegin(zone); }
+    ~ProfileScope() { profiler.ZoneEnd(zone); }
+};
+
+#define PROFILE_COUNT(counter) profiler.Count(counter)
+#define PROFILE_ADD(counter, amount) profiler.Count(counter, amount)
+#define PROFILE_ZONE(zone) ProfileScope profileScope(zone)
+#define PROFILE_FRAME_BEGIN() profiler.BeginFrame()
+#define PROFILE_FRAME_END() profiler.EndFrame()
+#define PROFILE_OVERLAY() (profiler.UpdateOverlay(), profiler.DrawOverlay())
+#else
+#define PROFILE_COUNT(counter) ((void)0)
+#define PROFILE_ADD(counter, amount) ((void)0)
+#define PROFILE_ZONE(zone) ((void)0)
+#define PROFILE_FRAME_BEGIN() ((void)0)
+#define PROFILE_FRAME_END() ((void)0)
+#define PROFILE_OVERLAY() ((void)0)
+#endif
+
+class LoadingScreen {
+private:
+    float progress = 0.0f;
+    int frameCounter = 0;
+    Sound loadingSound;
+
+public:
+    void Init() {
+        InitAudioDevice();
+        loadingSound = LoadSound("resources/loading.wav");
+        if (!soundEnabled) SetSoundVolume(loadingSound, 0.0f);
+    }
+
+    void Update() {
+        frameCounter++;
+        progress = (frameCounter / 180.0f);
+        if (progress >= 1.0f) {
+            gameState = MENU;
+            if (soundEnabled) StopSound(loadingSound);
+        }
+    }
+
+    void Draw() {
+        ClearBackground(RAYWHITE);
+        DrawText("CHEESY", screenWidth / 2 - 120, screenHeight / 2 - 100, 48, GOLD);
+        DrawText("CHESS", screenWidth / 2 - 80, screenHeight / 2 - 40, 48, GREEN);
+        int barWidth = 300, barHeight = 20;
+        int barX = screenWidth / 2 - barWidth / 2, barY = screenHeight / 2 + 50;
+        Rectangle barRect = { (float)barX, (float)barY, (float)barWidth, (float)barHeight };
+        DrawRectangleRounded(barRect, 0.3f, 8, DARKGRAY);
+        DrawRectangleRounded({ (float)barX, (float)barY, barWidth * progress, (float)barHeight }, 0.3f, 8, GOLD);
+        DrawRectangleRoundedLinesEx(barRect, 0.3f, 8, 2.0f, WHITE);
+        DrawText("Loading...", screenWidth / 2 - 50, screenHeight / 2 + 100, 20, LIGHTGRAY);
+        DrawText("v1.0", screenWidth - 50, screenHeight - 30, 16, GRAY);
+    }
+
+    void Unload() {
+        UnloadSound(loadingSound);
+        CloseAudioDevice();
+    }
+};
+
+class MenuScreen {
+private:
+    struct Button {
+        Rectangle rect;
+        string text;
+        Color color;
+        Color hoverColor;
+        bool isHovered = false;
+        Sound clickSound;
+    };
+    vector<Button> buttons;
+
+public:
+    void Init() {
+        buttons.clear();
+        buttons.push_back({ {screenWidth / 2 - 150, 300, 300, 60}, "Play", GREEN, LIME, false, LoadSound("resources/button_click.wav") });
+        buttons.push_back({ {screenWidth / 2 - 150, 380, 300, 60}, "Settings", BLUE, SKYBLUE, false, LoadSound("resources/button_click.wav") });
+        buttons.push_back({ {screenWidth / 2 - 150, 460, 300, 60}, "Achievements", PURPLE, MAGENTA, false, LoadSound("resources/button_click.wav") });
+        buttons.push_back({ {screenWidth / 2 - 150, 540, 300, 60}, "Exit", RED, MAROON, false, LoadSound("resources/button_click.wav") });
+        if (!soundEnabled) {
+            for (auto& button : buttons) SetSoundVolume(button.clickSound, 0.0f);
+        }
+    }
+
+    void Update() {
+        Vector2 mouse = input.MousePosition();
+        for (auto& button : buttons) {
+            button.isHovered = CheckCollisionPointRec(mouse, button.rect);
+            if (button.isHovered && input.MouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+                if (soundEnabled) PlaySound(button.clickSound);
+                if (button.text == "Play") gameState = GAME;
+                else if (button.text == "Settings") gameState = SETTINGS;
+                else if (button.text == "Achievements") gameState = ACHIEVEMENTS;
+                else if (button.text == "Exit") CloseWindow();
+            }
+        }
+    }
+
+    void Draw() {
+        ClearBackground(DARKGRAY);
+        for (int i = 0; i < screenWidth; i += 100) {
+            for (int j = 0; j < screenHeight; j += 100) {
+                DrawRectangle(i, j, 50, 50, Color{ 35, 35, 35, 255 });
+            }
+        }
+        DrawText("CHEESY CHESS", screenWidth / 2 - 200, 150, 60, GOLD);
+        DrawText("Master the Game", screenWidth / 2 - 120, 220, 24, LIGHTGRAY);
+        for (const auto& button : buttons) {
+            float scale = button.isHovered ? 1.05f : 1.0f;
+            Rectangle scaledRect = {
+                button.rect.x - (button.rect.width * scale - button.rect.width) / 2,
+                button.rect.y - (button.rect.height * scale - button.rect.height) / 2,
+                button.rect.width * scale,
+                button.rect.height * scale
+            };
+            Color currentColor = button.isHovered ? button.hoverColor : button.color;
+            DrawRectanglePro(scaledRect, { 0, 0 }, 0.0f, currentColor);
+            DrawRectangleLinesEx(scaledRect, 2, WHITE);
+            Vector2 textSize = MeasureTextEx(GetFontDefault(), button.text.c_str(), 24, 0);
+            DrawText(button.text.c_str(),
+                scaledRect.x + scaledRect.width / 2 - textSize.x / 2,
+                scaledRect.y + scaledRect.height / 2 - textSize.y / 2,
+                24, WHITE);
+        }
+    }
+
+    void Unload() {
+        for (auto& button : buttons) UnloadSound(button.clickSound);
+    }
+};
+
+class SettingsScreen {
+private:
+    struct Button {
+        Rectangle rect;
+        string text;
+        Color color;
+        Color hoverColor;
+        bool isHovered = false;
+        Sound clickSound;
+    };
+    vector<Button> buttons;
+
+public:
+    void Init() {
+        buttons.clear();
+        buttons.push_back({ {screenWidth / 2 - 150, 300, 300, 60}, soundEnabled ? "Sound: On" : "Sound: Off", GREEN, LIME, false, LoadSound("resources/button_click.wav") });
+        buttons.push_back({ {screenWidth / 2 - 150, 380, 300, 60}, colorScheme == 0 ? "Color: Beige/Brown" : "Color: Blue/White", BLUE, SKYBLUE, false, LoadSound("resources/button_click.wav") });
+        buttons.push_back({ {screenWidth / 2 - 150, 460, 300, 60}, "Back", RED, MAROON, false, LoadSound("resources/button_click.wav") });
+        if (!soundEnabled) {
+            for (auto& button : buttons) SetSoundVolume(button.clickSound, 0.0f);
+        }
+    }
+
+    void Update() {
+        Vector2 mouse = input.MousePosition();
+        for (auto& button : buttons) {
+            button.isHovered = CheckCollisionPointRec(mouse, button.rect);
+            if (button.isHovered && input.MouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+                if (soundEnabled) PlaySound(button.clickSound);
+                if (button.text.find("Sound") != string::npos) {
+                    soundEnabled = !soundEnabled;
+                    button.text = soundEnabled ? "Sound: On" : "Sound: Off";
+                    for (auto& b : buttons) SetSoundVolume(b.clickSound, soundEnabled ? 1.0f : 0.0f);
+                }
+                else if (button.text.find("Color") != string::npos) {
+                    colorScheme = (colorScheme + 1) % 2;
+                    button.text = colorScheme == 0 ? "Color: Beige/Brown" : "Color: Blue/White";
+                }
+                else if (button.text == "Back") gameState = MENU;
+            }
+        }
+        if (input.KeyPressed(KEY_ESCAPE)) gameState = MENU;
+    }
+
+    void Draw() {
+        ClearBackground(DARKGRAY);
+        DrawText("Settings", screenWidth / 2 - 100, 150, 40, WHITE);
+        for (const auto& button : buttons) {
+            float scale = button.isHovered ? 1.05f : 1.0f;
+            Rectangle scaledRect = {
+                button.rect.x - (button.rect.width * scale - button.rect.width) / 2,
+                button.rect.y - (button.rect.height * scale - button.rect.height) / 2,
+                button.rect.width * scale,
+                button.rect.height * scale
+            };
+            Color currentColor = button.isHovered ? button.hoverColor : button.color;
+            DrawRectanglePro(scaledRect, { 0, 0 }, 0.0f, currentColor);
+            DrawRectangleLinesEx(scaledRect, 2, WHITE);
+            Vector2 textSize = MeasureTextEx(GetFontDefault(), button.text.c_str(), 24, 0);
+            DrawText(button.text.c_str(),
+                scaledRect.x + scaledRect.width / 2 - textSize.x / 2,
+                scaledRect.y + scaledRect.height / 2 - textSize.y / 2,
+                24, WHITE);
+        }
+        DrawText("Press ESC to go back", 50, screenHeight - 50, 20, GRAY);
+    }
+
+    void Unload() {
+        for (auto& button : buttons) UnloadSound(button.clickSound);
+    }
+};
+
+class AchievementsScreen {
+private:
+    vector<Achievement> achievements;
+    struct Button {
+        Rectangle rect;
+        string text;
+        Color color;
+        Color hoverColor;
+        bool isHovered = false;
+        Sound clickSound;
+    };
+    Button backButton;
+
+public:
+    void Init(vector<Achievement>& ach) {
+        achievements = ach;
+        backButton = { {screenWidth / 2 - 150, screenHeight - 100, 300, 60}, "Back", RED, MAROON, false, LoadSound("resources/button_click.wav") };
+        if (!soundEnabled) SetSoundVolume(backButton.clickSound, 0.0f);
+    }
+
+    void Update() {
+        Vector2 mouse = input.MousePosition();
+        backButton.isHovered = CheckCollisionPointRec(mouse, backButton.rect);
+        if (backButton.isHovered && input.MouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+            if (soundEnabled) PlaySound(backButton.clickSound);
+            gameState = MENU;
+        }
+        if (input.KeyPressed(KEY_ESCAPE)) gameState = MENU;
+    }
+
+    void Draw() {
+        ClearBackground(DARKGRAY);
+        DrawText("Achievements", screenWidth / 2 - 120, 100, 40, WHITE);
+        int y = 150;
+        for (const auto& ach : achievements) {
+            string text = ach.name + (ach.unlocked ? " (Unlocked)" : " (Locked)");
+            Color color = ach.unlocked ? GREEN : GRAY;
+            DrawText(text.c_str(), screenWidth / 2 - 200, y, 20, color);
+            DrawText(ach.description.c_str(), screenWidth / 2 - 200, y + 25, 16, LIGHTGRAY);
+            y += 60;
+        }
+        float scale = backButton.isHovered ? 1.05f : 1.0f;
+        Rectangle scaledRect = {
+            backButton.rect.x - (backButton.rect.width * scale - backButton.rect.width) / 2,
+            backButton.rect.y - (backButton.rect.height * scale - backButton.rect.height) / 2,
+            backButton.rect.width * scale,
+            backButton.rect.height * scale
+        };
+        DrawRectanglePro(scaledRect, { 0, 0 }, 0.0f, backButton.isHovered ? backButton.hoverColor : backButton.color);
+        DrawRectangleLinesEx(scaledRect, 2, WHITE);
+        Vector2 textSize = MeasureTextEx(GetFontDefault(), backButton.text.c_str(), 24, 0);
+        DrawText(backButton.text.c_str(),
+            scaledRect.x + scaledRect.width / 2 - textSize.x / 2,
+            scaledRect.y + scaledRect.height / 2 - textSize.y / 2,
+            24, WHITE);
+        DrawText("Press ESC to go back", 50, screenHeight - 50, 20, GRAY);
+    }
+
+    void Unload() {
+        UnloadSound(backButton.clickSound);
+    }
+};
+
+class Board {
+public:
+    void Draw() {
+        PROFILE_ZONE(PZ_BOARD_DRAW);
+        DrawRectangle(boardOffsetX - 10, boardOffsetY - 10, boardSize + 20, boardSize + 20, DARKBROWN);
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 8; j++) {
+                Color color = ((i + j) % 2 == 0) ?
+                    (colorScheme == 0 ? BEIGE : WHITE) :
+                    (colorScheme == 0 ? BROWN : BLUE);
+                DrawRectangle(boardOffsetX + i * squareSize, boardOffsetY + j * squareSize, squareSize, squareSize, color);
+            }
+        }
+        for (int i = 0; i < 8; i++) {
+            char file = 'a' + i;
+            DrawText(TextFormat("%c", file), boardOffsetX + i * squareSize + squareSize / 2 - 5, boardOffsetY + boardSize + 5, 16, DARKGRAY);
+            char rank = '8' - i;
+            DrawText(TextFormat("%c", rank), boardOffsetX - 20, boardOffsetY + i * squareSize + squareSize / 2 - 8, 16, DARKGRAY);
+        }
+    }
+};
+
+class ChessGame {
+private:
+    Board board;
+    Piece pieces[32] = {};
+    int selectedPiece = -1;
+    bool whiteTurn = true;
+    string gameStatus = "White to move";
+    int moveCount = 0;
+    Sound moveSound;
+    int promotionPieceIndex = -1;
+    vector<Rectangle> promotionButtons;
+    vector<PieceType> promotionOptions = { QUEEN, ROOK, KNIGHT, BISHOP };
+    vector<Move> moveHistory;
+    vector<Achievement> achievements;
+    int movesWithoutCapture = 0;
+    bool gameEnded = false;
+    int lastPawnDoubleMoveTurn = -1;
+    int enPassantTargetX = -1, enPassantTargetY = -1;
+    Position position;              // rules-core mirror of `pieces`
+    vector<uint64_t> positionKeys;  // Zobrist keys of every position reached, for repetition
+    GameStatus status;              // recomputed once per move
+    MoveCode pendingPromotion = 0;
+    uint32_t explorerGames = 0;     // games in the opening explorer that continued from `position`
+    vector<string> explorerLines;   // most played continuations, formatted once per move
+    enum EngineTask { TASK_IDLE, TASK_MOVE, TASK_PONDER, TASK_ANALYSIS };
+    static const int computerMoveTimeMs = 1000;
+    unique_ptr<Engine> engine;      // created the first time the computer or analysis is switched on
+    EngineTask engineTask = TASK_IDLE;
+    bool computerEnabled = false, computerWhite = false, ponderEnabled = true, analysisEnabled = false;
+    uint64_t ponderKey = 0;         // position the ponder search assumes the opponent will reach
+    bool ponderHitPending = false;
+    chrono::steady_clock::time_point thinkStart;
+    int ponderHits = 0, ponderMisses = 0, analysisDepth = 0;
+    double thinkingMs = 0, savedMs = 0;
+    string engineInfo;
+    vector<string> analysisLines;
+
+public:
+    void Init() {
+        moveSound = LoadSound("resources/move.wav");
+        if (!soundEnabled) SetSoundVolume(moveSound, 0.0f);
+        Position start;
+        start.SetStartPosition();
+        StopEngine();
+        if (engine) engine->NewGame();
+        ponderHits = ponderMisses = 0;
+        thinkingMs = savedMs = 0;
+        engineInfo.clear();
+        analysisLines.clear();
+        LoadPosition(start);
+        achievements.clear();
+        achievements.push_back(Achievement("Marshall Defense", "Play 1. d4 d5 2. c4 Nf6 3. cxd5 Nxd5 4. e4 Nf6 5. Nc3 e6"));
+        achievements.push_back(Achievement("Italian Game", "Play 1. e4 e5 2. Nf3 Nc6 3. Bc4"));
+        achievements.push_back(Achievement("Sicilian Defense", "Play 1. e4 c5"));
+        achievements.push_back(Achievement("First Checkmate", "Win a game by checkmate"));
+        achievements.push_back(Achievement("Speedy Victory", "Win a game in under 10 moves"));
+        achievements.push_back(Achievement("Pacifist", "Complete 10 moves without capturing"));
+        achievements.push_back(Achievement("Pawn Power", "Promote a pawn to a queen"));
+    }
+
+    Piece CreatePiece(PieceType type, int x, int y, bool isWhite) {
+        Piece piece;
+        piece.x = x;
+        piece.y = y;
+        piece.isWhite = isWhite;
+        piece.active = true;
+        piece.type = type;
+        piece.hasMoved = false;
+        return piece;
+    }
+
+    void CheckAchievements(const Move& move) {
+        moveHistory.push_back(move);
+        if (move.isCapture) movesWithoutCapture = 0;
+        else movesWithoutCapture++;
+        if (movesWithoutCapture >= 10) {
+            for (auto& ach : achievements) {
+                if (ach.name == "Pacifist") ach.unlocked = true;
+            }
+        }
+        if (move.pieceType == PAWN && move.toY == (move.pieceType == PAWN && pieces[move.fromX + move.fromY * 8].isWhite ? 0 : 7)) {
+            for (auto& ach : achievements) {
+                if (ach.name == "Pawn Power") ach.unlocked = true;
+            }
+        }
+        if (moveCount <= 10 && gameEnded && gameStatus.find("checkmate") != string::npos) {
+            for (auto& ach : achievements) {
+                if (ach.name == "Speedy Victory") ach.unlocked = true;
+            }
+        }
+        if (gameEnded && gameStatus.find("checkmate") != string::npos) {
+            for (auto& ach : achievements) {
+                if (ach.name == "First Checkmate") ach.unlocked = true;
+            }
+        }
+        // Check for openings (simplified: check move sequence)
+        if (moveHistory.size() >= 5) {
+            // Marshall Defense: 1. d4 d5 2. c4 Nf6 3. cxd5 Nxd5 4. e4 Nf6 5. Nc3 e6
+            if (moveHistory.size() >= 10 &&
+                moveHistory[0].pieceType == PAWN && moveHistory[0].fromX == 3 && moveHistory[0].fromY == 6 && moveHistory[0].toY == 4 && // d4
+                moveHistory[1].pieceType == PAWN && moveHistory[1].fromX == 3 && moveHistory[1].fromY == 1 && moveHistory[1].toY == 3 && // d5
+                moveHistory[2].pieceType == PAWN && moveHistory[2].fromX == 2 && moveHistory[2].fromY == 6 && moveHistory[2].toY == 4 && // c4
+                moveHistory[3].pieceType == KNIGHT && moveHistory[3].fromX == 6 && moveHistory[3].fromY == 0 && moveHistory[3].toX == 5 && moveHistory[3].toY == 2 && // Nf6
+                moveHistory[4].pieceType == PAWN && moveHistory[4].fromX == 2 && moveHistory[4].fromY == 4 && moveHistory[4].toX == 3 && moveHistory[4].toY == 3 && moveHistory[4].isCapture && // cxd5
+                moveHistory[5].pieceType == KNIGHT && moveHistory[5].fromX == 5 && moveHistory[5].fromY == 2 && moveHistory[5].toX == 3 && moveHistory[5].toY == 3 && // Nxd5
+                moveHistory[6].pieceType == PAWN && moveHistory[6].fromX == 4 && moveHistory[6].fromY == 6 && moveHistory[6].toY == 4 && // e4
+                moveHistory[7].pieceType == KNIGHT && moveHistory[7].fromX == 3 && moveHistory[7].fromY == 3 && moveHistory[7].toX == 5 && moveHistory[7].toY == 2 && // Nf6
+                moveHistory[8].pieceType == KNIGHT && moveHistory[8].fromX == 2 && moveHistory[8].fromY == 7 && moveHistory[8].toX == 2 && moveHistory[8].toY == 5 && // Nc3
+                moveHistory[9].pieceType == PAWN && moveHistory[9].fromX == 4 && moveHistory[9].fromY == 1 && moveHistory[9].toY == 3) { // e6
+                for (auto& ach : achievements) {
+                    if (ach.name == "Marshall Defense") ach.unlocked = true;
+                }
+            }
+        }
+        if (moveHistory.size() >= 5) {
+            // Italian Game: 1. e4 e5 2. Nf3 Nc6 3. Bc4
+            if (moveHistory[0].pieceType == PAWN && moveHistory[0].fromX == 4 && moveHistory[0].fromY == 6 && moveHistory[0].toY == 4 &&
+                moveHistory[1].pieceType == PAWN && moveHistory[1].fromX == 4 && moveHistory[1].fromY == 1 && moveHistory[1].toY == 3 &&
+                moveHistory[2].pieceType == KNIGHT && moveHistory[2].fromX == 6 && moveHistory[2].fromY == 7 && moveHistory[2].toX == 5 && moveHistory[2].toY == 5 &&
+                moveHistory[3].pieceType == KNIGHT && moveHistory[3].fromX == 2 && moveHistory[3].fromY == 0 && moveHistory[3].toX == 2 && moveHistory[3].toY == 2 &&
+                moveHistory[4].pieceType == BISHOP && moveHistory[4].fromX == 5 && moveHistory[4].fromY == 7 && moveHistory[4].toX == 2 && moveHistory[4].toY == 4) {
+                for (auto& ach : achievements) {
+                    if (ach.name == "Italian Game") ach.unlocked = true;
+                }
+            }
+        }
+        if (moveHistory.size() >= 2) {
+            // Sicilian Defense: 1. e4 c5
+            if (moveHistory[0].pieceType == PAWN && moveHistory[0].fromX == 4 && moveHistory[0].fromY == 6 && moveHistory[0].toY == 4 &&
+                moveHistory[1].pieceType == PAWN && moveHistory[1].fromX == 2 && moveHistory[1].fromY == 1 && moveHistory[1].toY == 3) {
+                for (auto& ach : achievements) {
+                    if (ach.name == "Sicilian Defense") ach.unlocked = true;
+                }
+            }
+        }
+    }
+
+    void PromotePawn(int pieceIndex, PieceType newType) {
+        pieces[pieceIndex].type = newType;
+        promotionPieceIndex = -1;
+        gameState = GAME;
+        whiteTurn = !whiteTurn;
+        moveCount++;
+        if (newType == QUEEN) {
+            for (auto& ach : achievements) {
+                if (ach.name == "Pawn Power") ach.unlocked = true;
+            }
+        }
+        ApplyToPosition(MakeMoveCode(MoveFrom(pendingPromotion), MoveTo(pendingPromotion), newType));
+    }
+
+    // All rule evaluation on the game screen happens here, once per move.
+    void ComputeStatus() {
+        PROFILE_ZONE(PZ_RULES);
+        PROFILE_COUNT(PC_STATUS_COMPUTE);
+        status.Compute(position, positionKeys.data(), (int)positionKeys.size());
+        PROFILE_ADD(PC_LEGAL_MOVES, status.legalMoveCount);
+    }
+
+    // Finds the cached legal move for a click; promotions match regardless of the chosen piece.
+    bool FindLegalMove(int pieceIndex, int toX, int toY, MoveCode& move) const {
+        PROFILE_ZONE(PZ_RULES);
+        PROFILE_COUNT(PC_MOVE_LOOKUP);
+        int from = pieces[pieceIndex].y * 8 + pieces[pieceIndex].x;
+        int to = toY * 8 + toX;
+        for (int i = 0; i < status.legalMoveCount; i++) {
+            if (MoveFrom(status.legalMoves[i]) == from && MoveTo(status.legalMoves[i]) == to) {
+                move = status.legalMoves[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Looks up the current position in the opening explorer and formats the three most played moves
+    // with their white win / draw / black win percentages.
+    void RefreshExplorer() {
+        vector<ExplorerMove> moves;
+        explorerGames = explorer.Lookup(position.Key(), moves);
+        explorerLines.clear();
+        for (size_t i = 0; i < moves.size() && i < 3; i++) {
+            const ExplorerMove& move = moves[i];
+            explorerLines.push_back(TextFormat("%-7s %6u  %2.0f/%2.0f/%2.0f%%", position.MoveToSan(move.move).c_str(), move.games,
+                100.0 * move.whiteWins / move.games, 100.0 * move.draws / move.games, 100.0 * (move.games - move.whiteWins - move.draws) / move.games));
+        }
+    }
+
+    // Plays the move on the rules core and refreshes the cached status and the status line.
+    void ApplyToPosition(MoveCode move) {
+        position.MakeMove(move);
+        positionKeys.push_back(position.Key());
+        ComputeStatus();
+        RefreshExplorer();
+        gameEnded = status.IsOver();
+        switch (status.result) {
+        case PLAY_CHECKMATE:
+            gameStatus = whiteTurn ? "Black wins by checkmate!" : "White wins by checkmate!";
+            for (auto& ach : achievements) {
+                if (ach.name == "First Checkmate") ach.unlocked = true;
+                if (moveCount <= 10 && ach.name == "Speedy Victory") ach.unlocked = true;
+            }
+            break;
+        case PLAY_CHECK: gameStatus = whiteTurn ? "White is in check!" : "Black is in check!"; break;
+        case PLAY_STALEMATE: gameStatus = "Stalemate! Game is a draw."; break;
+        case PLAY_DRAW_FIFTY: gameStatus = "Draw by the fifty-move rule."; break;
+        case PLAY_DRAW_REPETITION: gameStatus = "Draw by threefold repetition."; break;
+        case PLAY_DRAW_MATERIAL: gameStatus = "Draw: insufficient material."; break;
+        default: gameStatus = whiteTurn ? "White to move" : "Black to move"; break;
+        }
+    }
+
+    // Moves the piece and whatever the move captures or drags along (en passant, castling rook) on the
+    // on-screen piece list. Promotion and turn bookkeeping are left to the caller.
+    Move MovePieces(int index, int toX, int toY) {
+        Move move = { pieces[index].x, pieces[index].y, toX, toY, pieces[index].type, false };
+        bool isEnPassant = (pieces[index].type == PAWN && toX == enPassantTargetX && toY == enPassantTargetY && lastPawnDoubleMoveTurn == moveCount);
+        for (int i = 0; i < 32; i++) {
+            if (i != index && pieces[i].active && pieces[i].x == toX && pieces[i].y == toY) {
+                move.isCapture = true;
+                move.capturedType = pieces[i].type;
+                pieces[i].active = false;
+                break;
+            }
+        }
+        if (isEnPassant) {
+            move.isCapture = true;
+            move.capturedType = PAWN;
+            int capturedPawnY = pieces[index].isWhite ? toY + 1 : toY - 1;
+            for (int i = 0; i < 32; i++) {
+                if (pieces[i].active && pieces[i].x == toX && pieces[i].y == capturedPawnY) {
+                    pieces[i].active = false;
+                    break;
+                }
+            }
+        }
+        pieces[index].x = toX;
+        pieces[index].y = toY;
+        pieces[index].hasMoved = true;
+        if (pieces[index].type == PAWN && abs(pieces[index].y - move.fromY) == 2) {
+            lastPawnDoubleMoveTurn = moveCount + 1;
+            enPassantTargetX = toX;
+            enPassantTargetY = pieces[index].isWhite ? toY + 1 : toY - 1;
+        }
+        else {
+            lastPawnDoubleMoveTurn = -1;
+            enPassantTargetX = -1;
+            enPassantTargetY = -1;
+        }
+        if (pieces[index].type == KING && abs(toX - move.fromX) == 2) {
+            int rookFromX = toX > move.fromX ? 7 : 0;
+            int rookToX = toX > move.fromX ? move.fromX + 1 : move.fromX - 1;
+            for (int i = 0; i < 32; i++) {
+                if (pieces[i].active && pieces[i].type == ROOK && pieces[i].x == rookFromX && pieces[i].y == move.fromY) {
+                    pieces[i].x = rookToX;
+                    pieces[i].hasMoved = true;
+                    break;
+                }
+            }
+        }
+        return move;
+    }
+
+    // Plays an engine move through the same piece-list path as a click, promoting directly.
+    void PlayEngineMove(MoveCode code) {
+        int index = PieceIndexAt(MoveFrom(code) % 8, MoveFrom(code) / 8);
+        if (index < 0) return;
+        if (soundEnabled) PlaySound(moveSound);
+        Move move = MovePieces(index, MoveTo(code) % 8, MoveTo(code) / 8);
+        if (MovePromotion(code) != PAWN) pieces[index].type = MovePromotion(code);
+        whiteTurn = !whiteTurn;
+        moveCount++;
+        CheckAchievements(move);
+        ApplyToPosition(code);
+    }
+
+    void StopEngine() {
+        if (engine) {
+            engine->Stop();
+            engine->Wait();
+        }
+        engineTask = TASK_IDLE;
+    }
+
+    // Formats engine lines in SAN from the current position, e.g. "+0.35 e4 e5 Nf3".
+    string FormatEngineLine(const Engine::Line& line) const {
+        string text = abs(line.score) >= mateScore - maxSearchPly ? FormatSearchScore(line.score) : TextFormat("%+.2f", line.score / 100.0);
+        Position walk = position;
+        for (size_t i = 0; i < line.pv.size() && i < 5; i++) {
+            text += " " + walk.MoveToSan(line.pv[i]);
+            walk.MakeMove(line.pv[i]);
+        }
+        return text;
+    }
+
+    // C: computer takes the side not to move, P: pondering on/off, A: multi-PV analysis on/off.
+    // The computer thinks on a background thread; after its move it ponders on the predicted reply
+    // and on a ponder hit the search already under way becomes the reply.
+    void UpdateEngine() {
+        if (input.KeyPressed(KEY_C)) {
+            computerEnabled = !computerEnabled;
+            computerWhite = !whiteTurn;
+            analysisEnabled = false;
+            StopEngine();
+        }
+        if (input.KeyPressed(KEY_P)) {
+            ponderEnabled = !ponderEnabled;
+            if (engineTask == TASK_PONDER) StopEngine();
+        }
+        if (input.KeyPressed(KEY_A)) {
+            analysisEnabled = !analysisEnabled;
+            computerEnabled = false;
+            analysisLines.clear();
+            StopEngine();
+        }
+        if (gameEnded) {
+            if (engineTask != TASK_IDLE) StopEngine();
+            return;
+        }
+        if (!engine && (computerEnabled || analysisEnabled)) engine.reset(new Engine(20));
+        if (analysisEnabled) {
+            if (engineTask != TASK_ANALYSIS || engine->Root().Key() != position.Key()) {
+                StopEngine();
+                Engine::Limits limits;
+                limits.multiPv = 3;
+                limits.infinite = true;
+                engine->Start(position, positionKeys, limits);
+                engineTask = TASK_ANALYSIS;
+                analysisDepth = 0;
+            }
+            Engine::Report report = engine->Snapshot();
+            if (report.depth != analysisDepth) {
+                analysisDepth = report.depth;
+                analysisLines.clear();
+                for (const Engine::Line& line : report.lines) analysisLines.push_back(TextFormat("d%d %s", report.depth, FormatEngineLine(line).c_str()));
+            }
+            return;
+        }
+        if (!computerEnabled || gameState != GAME || whiteTurn != computerWhite) return;
+        auto now = chrono::steady_clock::now();
+        if (engineTask == TASK_PONDER) {
+            ponderHitPending = position.Key() == ponderKey;
+            if (ponderHitPending) {
+                engine->PonderHit();
+                ponderHits++;
+                engineTask = TASK_MOVE;
+            }
+            else {
+                ponderMisses++;
+                StopEngine();
+            }
+            thinkStart = now;
+        }
+        if (engineTask == TASK_IDLE) {
+            Engine::Limits limits;
+            limits.moveTimeMs = computerMoveTimeMs;
+            engine->Start(position, positionKeys, limits);
+            engineTask = TASK_MOVE;
+            thinkStart = now;
+        }
+        if (engineTask != TASK_MOVE || !engine->Finished()) return;
+        Engine::Report report = engine->Wait();
+        engineTask = TASK_IDLE;
+        double ms = chrono::duration<double, milli>(now - thinkStart).count();
+        thinkingMs += ms;
+        if (ponderHitPending) savedMs += max(0.0, computerMoveTimeMs - ms);
+        ponderHitPending = false;
+        if (report.lines.empty()) return;
+        vector<MoveCode> pv = report.lines[0].pv;
+        engineInfo = TextFormat("%s (d%d, %.0f ms)", FormatEngineLine(report.lines[0]).c_str(), report.depth, ms);
+        PlayEngineMove(pv[0]);
+        if (ponderEnabled && !gameEnded && pv.size() > 1 && position.IsLegal(pv[1])) {
+            Position predicted = position;
+            predicted.MakeMove(pv[1]);
+            vector<uint64_t> keys = positionKeys;
+            keys.push_back(predicted.Key());
+            Engine::Limits limits;
+            limits.moveTimeMs = computerMoveTimeMs;
+            limits.ponder = true;
+            engine->Start(predicted, keys, limits);
+            ponderKey = predicted.Key();
+            engineTask = TASK_PONDER;
+        }
+    }
+
+    void HandleMouse() {
+        if (gameEnded || (computerEnabled && whiteTurn == computerWhite)) return;
+        if (gameState == PROMOTION) {
+            Vector2 mouse = input.MousePosition();
+            for (size_t i = 0; i < promotionButtons.size(); i++) {
+                if (CheckCollisionPointRec(mouse, promotionButtons[i]) && input.MouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+                    if (soundEnabled) PlaySound(moveSound);
+                    PromotePawn(promotionPieceIndex, promotionOptions[i]);
+                    return;
+                }
+            }
+            return;
+        }
+        if (input.MouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+            Vector2 mouse = input.MousePosition();
+            int mx = (int)(mouse.x - boardOffsetX) / squareSize;
+            int my = (int)(mouse.y - boardOffsetY) / squareSize;
+            if (mx < 0 || mx >= 8 || my < 0 || my >= 8) return;
+            if (selectedPiece == -1) {
+                for (int i = 0; i < 32; i++) {
+                    if (pieces[i].active && pieces[i].x == mx && pieces[i].y == my && pieces[i].isWhite == whiteTurn) {
+                        selectedPiece = i;
+                        break;
+                    }
+                }
+            }
+            else {
+                MoveCode legalMove;
+                if (FindLegalMove(selectedPiece, mx, my, legalMove)) {
+                    if (soundEnabled) PlaySound(moveSound);
+                    Move move = MovePieces(selectedPiece, mx, my);
+                    if (pieces[selectedPiece].type == PAWN && ((pieces[selectedPiece].isWhite && my == 0) || (!pieces[selectedPiece].isWhite && my == 7))) {
+                        promotionPieceIndex = selectedPiece;
+                        pendingPromotion = legalMove;
+                        gameState = PROMOTION;
+                        promotionButtons.clear();
+                        float startX = screenWidth / 2 - 200;
+                        for (int i = 0; i < 4; i++) {
+                            promotionButtons.push_back({ startX + i * 100, screenHeight / 2 - 50, 80, 80 });
+                        }
+                    }
+                    else {
+                        whiteTurn = !whiteTurn;
+                        moveCount++;
+                        CheckAchievements(move);
+                        ApplyToPosition(legalMove);
+                    }
+                }
+                selectedPiece = -1;
+            }
+        }
+        if (input.MouseButtonPressed(MOUSE_BUTTON_RIGHT)) selectedPiece = -1;
+    }
+
+    void Draw() {
+        ClearBackground(DARKGRAY);
+        board.Draw();
+        {
+            PROFILE_ZONE(PZ_PIECE_DRAW);
+            for (int i = 0; i < 32; i++) {
+                if (!pieces[i].active) continue;
+                int pixelX = boardOffsetX + pieces[i].x * squareSize + 5;
+                int pixelY = boardOffsetY + pieces[i].y * squareSize + 5;
+                DrawRectangle(pixelX, pixelY, squareSize - 10, squareSize - 10, pieces[i].isWhite ? WHITE : BLACK);
+                string pieceChar = GetPieceChar(pieces[i].type);
+                Color textColor = pieces[i].isWhite ? BLACK : WHITE;
+                DrawText(pieceChar.c_str(), pixelX + squareSize / 2 - 8, pixelY + squareSize / 2 - 8, 16, textColor);
+            }
+        }
+        if (selectedPiece != -1) {
+            int highlightX = boardOffsetX + pieces[selectedPiece].x * squareSize;
+            int highlightY = boardOffsetY + pieces[selectedPiece].y * squareSize;
+            DrawRectangleLines(highlightX, highlightY, squareSize, squareSize, YELLOW);
+            DrawRectangleLines(highlightX + 1, highlightY + 1, squareSize - 2, squareSize - 2, YELLOW);
+        }
+        if (gameState == PROMOTION) {
+            DrawRectangle(screenWidth / 2 - 220, screenHeight / 2 - 100, 440, 200, Color{ 30, 30, 30, 200 });
+            DrawText("Select Promotion", screenWidth / 2 - 100, screenHeight / 2 - 80, 24, WHITE);
+            for (size_t i = 0; i < promotionButtons.size(); i++) {
+                bool isHovered = CheckCollisionPointRec(input.MousePosition(), promotionButtons[i]);
+                DrawRectangleRec(promotionButtons[i], isHovered ? LIME : GREEN);
+                DrawRectangleLinesEx(promotionButtons[i], 2, WHITE);
+                string option = GetPieceChar(promotionOptions[i]);
+                Vector2 textSize = MeasureTextEx(GetFontDefault(), option.c_str(), 24, 0);
+                DrawText(option.c_str(),
+                    promotionButtons[i].x + promotionButtons[i].width / 2 - textSize.x / 2,
+                    promotionButtons[i].y + promotionButtons[i].height / 2 - textSize.y / 2,
+                    24, WHITE);
+            }
+        }
+        DrawRectangle(boardOffsetX + boardSize + 30, boardOffsetY, 300, 400, Color{ 30, 30, 30, 255 });
+        DrawRectangleLines(boardOffsetX + boardSize + 30, boardOffsetY, 300, 400, WHITE);
+        DrawText("Game Info", boardOffsetX + boardSize + 50, boardOffsetY + 20, 24, WHITE);
+        DrawText(gameStatus.c_str(), boardOffsetX + boardSize + 50, boardOffsetY + 60, 20, LIGHTGRAY);
+        DrawText(TextFormat("Move: %d", moveCount), boardOffsetX + boardSize + 50, boardOffsetY + 90, 20, LIGHTGRAY);
+        DrawText("Mode: Offline", boardOffsetX + boardSize + 50, boardOffsetY + 120, 20, LIGHTGRAY);
+        DrawText("Controls:", boardOffsetX + boardSize + 50, boardOffsetY + 200, 20, YELLOW);
+        DrawText("Left click: Select/Move", boardOffsetX + boardSize + 50, boardOffsetY + 230, 16, LIGHTGRAY);
+        DrawText("Right click: Deselect", boardOffsetX + boardSize + 50, boardOffsetY + 250, 16, LIGHTGRAY);
+        DrawText("ESC: Back to menu", boardOffsetX + boardSize + 50, boardOffsetY + 270, 16, LIGHTGRAY);
+        if (explorer.IsOpen()) {
+            DrawText(TextFormat("Explorer: %u games", explorerGames), boardOffsetX + boardSize + 50, boardOffsetY + 300, 20, YELLOW);
+            for (size_t i = 0; i < explorerLines.size(); i++) {
+                DrawText(explorerLines[i].c_str(), boardOffsetX + boardSize + 50, boardOffsetY + 328 + (int)i * 20, 16, LIGHTGRAY);
+            }
+        }
+        int engineY = boardOffsetY + 420;
+        DrawRectangle(boardOffsetX + boardSize + 30, engineY, 300, 220, Color{ 30, 30, 30, 255 });
+        DrawRectangleLines(boardOffsetX + boardSize + 30, engineY, 300, 220, WHITE);
+        DrawText("Engine", boardOffsetX + boardSize + 50, engineY + 15, 20, YELLOW);
+        DrawText(TextFormat("C: computer %s  P: ponder %s", computerEnabled ? (computerWhite ? "White" : "Black") : "off", ponderEnabled ? "on" : "off"),
+            boardOffsetX + boardSize + 50, engineY + 45, 14, LIGHTGRAY);
+        DrawText(TextFormat("A: analysis %s", analysisEnabled ? "on" : "off"), boardOffsetX + boardSize + 50, engineY + 63, 14, LIGHTGRAY);
+        if (analysisEnabled) {
+            for (size_t i = 0; i < analysisLines.size(); i++) {
+                DrawText(analysisLines[i].c_str(), boardOffsetX + boardSize + 50, engineY + 95 + (int)i * 20, 14, WHITE);
+            }
+        }
+        else if (computerEnabled) {
+            DrawText(engineTask == TASK_MOVE ? "Thinking..." : engineTask == TASK_PONDER ? "Pondering..." : engineInfo.c_str(),
+                boardOffsetX + boardSize + 50, engineY + 95, 14, WHITE);
+            DrawText(TextFormat("Ponder hits %d / misses %d", ponderHits, ponderMisses), boardOffsetX + boardSize + 50, engineY + 120, 14, LIGHTGRAY);
+            DrawText(TextFormat("Saved %.1f s of %.1f s thinking", savedMs / 1000.0, (thinkingMs + savedMs) / 1000.0),
+                boardOffsetX + boardSize + 50, engineY + 140, 14, LIGHTGRAY);
+        }
+        PROFILE_OVERLAY();
+        if ((gameState == GAME || gameState == PROMOTION) && input.KeyPressed(KEY_ESCAPE)) {
+            gameState = MENU;
+            gameEnded = true;
+        }
+    }
+
+    string GetPieceChar(PieceType type) {
+        switch (type) {
+        case PAWN: return "P";
+        case ROOK: return "R";
+        case KNIGHT: return "N";
+        case BISHOP: return "B";
+        case QUEEN: return "Q";
+        case KING: return "K";
+        default: return "";
+        }
+    }
+
+    // Rebuilds the piece list from a rules-core position so headless tools can drive the game rules.
+    void LoadPosition(const Position& position) {
+        for (auto& piece : pieces) piece = Piece();
+        int index = 0;
+        for (int sq = 0; sq < 64 && index < 32; sq++) {
+            unsigned char code = position.board[sq];
+            if (!code) continue;
+            Piece piece = CreatePiece(PieceCodeType(code), sq % 8, sq / 8, PieceCodeWhite(code));
+            int homeY = piece.isWhite ? 7 : 0;
+            unsigned char kingside = piece.isWhite ? WHITE_KINGSIDE : BLACK_KINGSIDE;
+            unsigned char queenside = piece.isWhite ? WHITE_QUEENSIDE : BLACK_QUEENSIDE;
+            if (piece.type == PAWN) piece.hasMoved = piece.y != (piece.isWhite ? 6 : 1);
+            else if (piece.type == KING) piece.hasMoved = !(position.castling & (kingside | queenside));
+            else if (piece.type == ROOK) {
+                piece.hasMoved = !(piece.y == homeY && ((piece.x == 7 && (position.castling & kingside)) || (piece.x == 0 && (position.castling & queenside))));
+            }
+            pieces[index++] = piece;
+        }
+        whiteTurn = position.whiteToMove;
+        moveCount = (position.fullmoveNumber - 1) * 2 + (position.whiteToMove ? 0 : 1);
+        selectedPiece = -1;
+        promotionPieceIndex = -1;
+        gameEnded = false;
+        moveHistory.clear();
+        movesWithoutCapture = position.halfmoveClock;
+        enPassantTargetX = position.epSquare >= 0 ? position.epSquare % 8 : -1;
+        enPassantTargetY = position.epSquare >= 0 ? position.epSquare / 8 : -1;
+        lastPawnDoubleMoveTurn = position.epSquare >= 0 ? moveCount : -1;
+        gameStatus = whiteTurn ? "White to move" : "Black to move";
+        this->position = position;
+        positionKeys.assign(1, position.Key());
+        ComputeStatus();
+        RefreshExplorer();
+    }
+
+    const GameStatus& GetGameStatus() const { return status; }
+
+    int PieceIndexAt(int x, int y) const {
+        for (int i = 0; i < 32; i++) {
+            if (pieces[i].active && pieces[i].x == x && pieces[i].y == y) return i;
+        }
+        return -1;
+    }
+
+    vector<Achievement>& GetAchievements() { return achievements; }
+    const string& GetStatus() const { return gameStatus; }
+
+    void Unload() {
+        StopEngine();
+        UnloadSound(moveSound);
+    }
 };
 
-class LoadingScreen {
-private:
-    float progress = 0.0f;
-    int frameCounter = 0;
-    Sound loadingSound;
+// Random positions from random playouts, each with a mix of legal and arbitrary candidate moves.
+MoveBatch MakeBenchmarkBatch(int positionCount, int movesPerPosition, unsigned int seed) {
+    mt19937 rng(seed);
+    MoveBatch batch;
+    MoveCode legal[maxMoves];
+    while ((int)batch.positions.size() < positionCount) {
+        Position position;
+        position.SetStartPosition();
+        int plies = rng() % 80;
+        for (int ply = 0; ply < plies; ply++) {
+            int n = position.GenerateLegalMoves(legal);
+            if (n == 0) break;
+            position.MakeMove(legal[rng() % n]);
+        }
+        int n = position.GenerateLegalMoves(legal);
+        if (n == 0) continue;
+        batch.positions.push_back(position);
+        for (int i = 0; i < movesPerPosition; i++) {
+            MoveCode move = i % 2 == 0 ? legal[rng() % n] : MakeMoveCode(rng() % 64, rng() % 64);
+            batch.Add((uint32_t)batch.positions.size() - 1, move);
+        }
+    }
+    // Candidates arrive in arbitrary order, as they would from many clients.
+    for (size_t i = batch.Size(); i > 1; i--) {
+        size_t j = rng() % i;
+        swap(batch.positionIndex[i - 1], batch.positionIndex[j]);
+        swap(batch.moves[i - 1], batch.moves[j]);
+    }
+    return batch;
+}
 
-public:
-    void Init() {
-        InitAudioDevice();
-        loadingSound = LoadSound("resources/loading.wav");
-        if (!soundEnabled) SetSoundVolume(loadingSound, 0.0f);
+int RunBatchBenchmark(int positionCount, int movesPerPosition, int threadCount) {
+    typedef chrono::steady_clock Clock;
+    MoveBatch batch = MakeBenchmarkBatch(positionCount, movesPerPosition, 2024);
+    size_t count = batch.Size();
+    printf("Batch validation benchmark: %zu candidate moves over %zu positions, %d threads\n", count, batch.positions.size(), threadCount);
+
+    auto start = Clock::now();
+
+    // Per-call through the rules core, in arrival order.
+    vector<uint8_t> singleLegal(count), singleStatus(count);
+    GameStatus after;
+    for (size_t i = 0; i < count; i++) {
+        const Position& position = batch.positions[batch.positionIndex[i]];
+        singleLegal[i] = position.IsLegal(batch.moves[i]);
+        singleStatus[i] = PLAY_ONGOING;
+        if (singleLegal[i]) {
+            Position next = position;
+            next.MakeMove(batch.moves[i]);
+            after.Compute(next, nullptr, 0, false);
+            singleStatus[i] = (uint8_t)after.result;
+        }
     }
+    double singleSeconds = chrono::duration<double>(Clock::now() - start).count();
 
-    void Update() {
-        frameCounter++;
-        progress = (frameCounter / 180.0f);
-        if (progress >= 1.0f) {
-            gameState = MENU;
-            if (soundEnabled) StopSound(loadingSound);
+    start = Clock::now();
+    ValidateMoveBatch(batch, threadCount);
+    double batchSeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    size_t legalCount = 0;
+    bool match = true;
+    for (size_t i = 0; i < count; i++) {
+        legalCount += batch.legal[i];
+        match = match && batch.legal[i] == singleLegal[i] && batch.status[i] == singleStatus[i];
+    }
+    printf("Per-call Position::IsLegal+Status: %10.0f moves/s\n", count / singleSeconds);
+    printf("Batched ValidateMoveBatch:         %10.0f moves/s (%.1fx per-call)\n", count / batchSeconds, singleSeconds / batchSeconds);
+    printf("Legal candidates: %zu, batch matches per-call: %s\n", legalCount, match ? "yes" : "NO");
+    return match ? 0 : 1;
+}
+
+// Compact training sample: four bits per square plus side to move, castling, en passant and result.
+struct PackedPosition {
+    uint8_t squares[32];
+    uint8_t flags;    // bit 0: White to move, bits 1-4: castling rights
+    int8_t epSquare;
+    uint8_t result;   // 0 = Black won, 1 = draw, 2 = White won
+
+    void Pack(const Position& position, int gameResult) {
+        for (int i = 0; i < 32; i++) squares[i] = (uint8_t)(position.board[2 * i] | (position.board[2 * i + 1] << 4));
+        flags = (uint8_t)((position.whiteToMove ? 1 : 0) | (position.castling << 1));
+        epSquare = position.epSquare;
+        result = (uint8_t)gameResult;
+    }
+
+    void Unpack(Position& position) const {
+        for (int i = 0; i < 32; i++) {
+            position.board[2 * i] = squares[i] & 15;
+            position.board[2 * i + 1] = squares[i] >> 4;
         }
+        position.whiteToMove = flags & 1;
+        position.castling = (unsigned char)(flags >> 1);
+        position.epSquare = epSquare;
+        position.halfmoveClock = 0;
+        position.fullmoveNumber = 1;
     }
+};
 
-    void Draw() {
-        ClearBackground(RAYWHITE);
-        DrawText("CHEESY", screenWidth / 2 - 120, screenHeight / 2 - 100, 48, GOLD);
-        DrawText("CHESS", screenWidth / 2 - 80, screenHeight / 2 - 40, 48, GREEN);
-        int barWidth = 300, barHeight = 20;
-        int barX = screenWidth / 2 - barWidth / 2, barY = screenHeight / 2 + 50;
-        Rectangle barRect = { (float)barX, (float)barY, (float)barWidth, (float)barHeight };
-        DrawRectangleRounded(barRect, 0.3f, 8, DARKGRAY);
-        DrawRectangleRounded({ (float)barX, (float)barY, barWidth * progress, (float)barHeight }, 0.3f, 8, GOLD);
-        DrawRectangleRoundedLinesEx(barRect, 0.3f, 8, 2.0f, WHITE);
-        DrawText("Loading...", screenWidth / 2 - 50, screenHeight / 2 + 100, 20, LIGHTGRAY);
-        DrawText("v1.0", screenWidth - 50, screenHeight - 30, 16, GRAY);
+// Reads "FEN result" lines. The result may be written as 1-0 / 0-1 / 1/2-1/2 (optionally quoted,
+// as in EPD c9 fields) or as [1.0] / [0.5] / [0.0]. Lines without a result are skipped.
+bool LoadTuningPositions(const char* path, vector<PackedPosition>& positions) {
+    FILE* file = fopen(path, "r");
+    if (!file) return false;
+    char buffer[512];
+    Position position;
+    while (fgets(buffer, sizeof(buffer), file)) {
+        string line = buffer;
+        int result = -1;
+        size_t bracket = line.find('[');
+        if (line.find("1/2-1/2") != string::npos) result = 1;
+        else if (line.find("1-0") != string::npos) result = 2;
+        else if (line.find("0-1") != string::npos) result = 0;
+        else if (bracket != string::npos) {
+            double value = atof(line.c_str() + bracket + 1);
+            result = value > 0.75 ? 2 : value > 0.25 ? 1 : 0;
+        }
+        if (result < 0 || !position.SetFromFEN(line.substr(0, min(bracket, line.find('"'))))) continue;
+        PackedPosition packed;
+        packed.Pack(position, result);
+        positions.push_back(packed);
     }
+    fclose(file);
+    return true;
+}
 
-    void Unload() {
-        UnloadSound(loadingSound);
-        CloseAudioDevice();
+double TexelSigmoid(double score, double scale) {
+    return 1.0 / (1.0 + pow(10.0, -scale * score / 400.0));
+}
+
+// Resolves positions[begin, end) with quiescence search under the current integer weights and
+// stores the quiet leaf each score comes from.
+void ResolveTexelLeaves(const vector<PackedPosition>& positions, size_t begin, size_t end, vector<PackedPosition>& leaves) {
+    Position position, leaf;
+    for (size_t i = begin; i < end; i++) {
+        positions[i].Unpack(position);
+        Quiescence(position, -100000, 100000, &leaf);
+        leaves[i].Pack(leaf, positions[i].result);
+    }
+}
+
+// Evaluates leaves[begin, end) with the exact weights and accumulates the squared error and its
+// gradient into this thread's own accumulators. The loss is summed locally and stored once, since
+// the per-thread loss slots share a cache line.
+void AccumulateTexelGradient(const vector<PackedPosition>& leaves, size_t begin, size_t end, const vector<double>& weights,
+    double scale, double& loss, vector<double>& gradient) {
+    uint16_t index[maxEvalFeatures];
+    int8_t coefficient[maxEvalFeatures];
+    Position leaf;
+    double sum = 0.0;
+    for (size_t i = begin; i < end; i++) {
+        leaves[i].Unpack(leaf);
+        int count = ExtractEvalFeatures(leaf, index, coefficient);
+        double score = 0.0;
+        for (int f = 0; f < count; f++) score += weights[index[f]] * coefficient[f];
+        double predicted = TexelSigmoid(score, scale);
+        double error = predicted - leaves[i].result * 0.5;
+        sum += error * error;
+        double slope = 2.0 * error * predicted * (1.0 - predicted) * scale * log(10.0) / 400.0;
+        for (int f = 0; f < count; f++) gradient[index[f]] += slope * coefficient[f];
+    }
+    loss = sum;
+}
+
+void ResolveTexelPass(const vector<PackedPosition>& positions, vector<PackedPosition>& leaves, int threadCount) {
+    leaves.resize(positions.size());
+    vector<thread> workers;
+    for (int t = 0; t < threadCount; t++) {
+        size_t begin = positions.size() * t / threadCount, end = positions.size() * (t + 1) / threadCount;
+        workers.emplace_back(ResolveTexelLeaves, cref(positions), begin, end, ref(leaves));
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+double TexelPass(const vector<PackedPosition>& leaves, const vector<double>& weights, double scale, int threadCount, vector<double>* gradient) {
+    vector<double> losses(threadCount, 0.0);
+    vector<vector<double>> gradients(threadCount, vector<double>(EVAL_TERM_COUNT, 0.0));
+    vector<thread> workers;
+    for (int t = 0; t < threadCount; t++) {
+        size_t begin = leaves.size() * t / threadCount, end = leaves.size() * (t + 1) / threadCount;
+        workers.emplace_back(AccumulateTexelGradient, cref(leaves), begin, end, cref(weights), scale, ref(losses[t]), ref(gradients[t]));
+    }
+    for (auto& worker : workers) worker.join();
+    double loss = 0.0;
+    for (int t = 0; t < threadCount; t++) {
+        loss += losses[t];
+        if (!gradient) continue;
+        for (int i = 0; i < EVAL_TERM_COUNT; i++) (*gradient)[i] += gradients[t][i];
+    }
+    return loss / max<size_t>(leaves.size(), 1);
+}
+
+// --tune <dataset> [epochs] [threads] [output]: fits the evaluation weights with Adam. Quiet leaves
+// are re-resolved with the latest weights every few epochs; in between only the cheap linear
+// evaluation and gradient run.
+int RunTexelTuner(const char* dataPath, int epochs, int threadCount, const char* outPath) {
+    typedef chrono::steady_clock Clock;
+    vector<PackedPosition> positions;
+    auto start = Clock::now();
+    if (!LoadTuningPositions(dataPath, positions) || positions.empty()) {
+        fprintf(stderr, "No labeled positions in '%s'\n", dataPath);
+        return 1;
+    }
+    printf("Loaded %zu positions (%.1f MB) in %.2f s\n", positions.size(), positions.size() * sizeof(PackedPosition) / 1048576.0,
+        chrono::duration<double>(Clock::now() - start).count());
+    vector<double> weights(evalWeights, evalWeights + EVAL_TERM_COUNT);
+    vector<PackedPosition> leaves;
+    ResolveTexelPass(positions, leaves, threadCount);
+
+    // Fit the sigmoid scale to the starting weights so the tuner only moves the weights.
+    double scale = 1.0, bestLoss = TexelPass(leaves, weights, scale, threadCount, nullptr);
+    for (double step = 0.5; step > 0.01; step /= 2) {
+        for (double candidate : { scale - step, scale + step }) {
+            if (candidate <= 0.0) continue;
+            double loss = TexelPass(leaves, weights, candidate, threadCount, nullptr);
+            if (loss < bestLoss) { bestLoss = loss; scale = candidate; }
+        }
+    }
+    printf("Sigmoid scale %.3f, initial loss %.6f\n", scale, bestLoss);
+
+    const int resolveInterval = 8;
+    const double learningRate = 1.0, beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+    vector<double> momentum(EVAL_TERM_COUNT, 0.0), velocity(EVAL_TERM_COUNT, 0.0);
+    auto tuneStart = Clock::now();
+    for (int epoch = 1; epoch <= epochs; epoch++) {
+        if (epoch % resolveInterval == 0) {
+            for (int i = 0; i < EVAL_TERM_COUNT; i++) evalWeights[i] = (int)lround(weights[i]);
+            ResolveTexelPass(positions, leaves, threadCount);
+        }
+        vector<double> gradient(EVAL_TERM_COUNT, 0.0);
+        double loss = TexelPass(leaves, weights, scale, threadCount, &gradient);
+        for (int i = 0; i < EVAL_TERM_COUNT; i++) {
+            double g = gradient[i] / positions.size();
+            momentum[i] = beta1 * momentum[i] + (1 - beta1) * g;
+            velocity[i] = beta2 * velocity[i] + (1 - beta2) * g * g;
+            double mHat = momentum[i] / (1 - pow(beta1, epoch)), vHat = velocity[i] / (1 - pow(beta2, epoch));
+            weights[i] -= learningRate * mHat / (sqrt(vHat) + epsilon);
+        }
+        double elapsed = chrono::duration<double>(Clock::now() - tuneStart).count();
+        printf("Epoch %d: loss %.6f (%.2f epochs/s, %.0f positions/s)\n", epoch, loss, epoch / elapsed, epoch * positions.size() / elapsed);
+        fflush(stdout);
     }
+    for (int i = 0; i < EVAL_TERM_COUNT; i++) evalWeights[i] = (int)lround(weights[i]);
+    if (!SaveEvalWeights(outPath, weights.data())) {
+        fprintf(stderr, "Could not write '%s'\n", outPath);
+        return 1;
+    }
+    printf("Wrote %s\n", outPath);
+    return 0;
+}
+
+struct MatePuzzle {
+    Position position;
+    int mateIn = 0;
+    string id;
 };
 
-class MenuScreen {
-private:
-    struct Button {
-        Rectangle rect;
-        string text;
-        Color color;
-        Color hoverColor;
-        bool isHovered = false;
-        Sound clickSound;
-    };
-    vector<Button> buttons;
+// Reads EPD lines; "dm N" gives the expected mate distance, "id" an optional name.
+bool LoadMatePuzzles(const char* path, int defaultMateIn, vector<MatePuzzle>& puzzles) {
+    FILE* file = fopen(path, "r");
+    if (!file) return false;
+    char buffer[512];
+    while (fgets(buffer, sizeof(buffer), file)) {
+        string line = buffer;
+        MatePuzzle puzzle;
+        if (!puzzle.position.SetFromFEN(line)) continue;
+        size_t dm = line.find(" dm ");
+        puzzle.mateIn = dm != string::npos ? atoi(line.c_str() + dm + 4) : defaultMateIn;
+        size_t id = line.find("id \"");
+        puzzle.id = id != string::npos ? line.substr(id + 4, line.find('"', id + 4) - id - 4) : "#" + to_string(puzzles.size() + 1);
+        if (puzzle.mateIn > 0) puzzles.push_back(puzzle);
+    }
+    fclose(file);
+    return true;
+}
 
-public:
-    void Init() {
-        buttons.clear();
-        buttons.push_back({ {screenWidth / 2 - 150, 300, 300, 60}, "Play", GREEN, LIME, false, LoadSound("resources/button_click.wav") });
-        buttons.push_back({ {screenWidth / 2 - 150, 380, 300, 60}, "Settings", BLUE, SKYBLUE, false, LoadSound("resources/button_click.wav") });
-        buttons.push_back({ {screenWidth / 2 - 150, 460, 300, 60}, "Achievements", PURPLE, MAGENTA, false, LoadSound("resources/button_click.wav") });
-        buttons.push_back({ {screenWidth / 2 - 150, 540, 300, 60}, "Exit", RED, MAROON, false, LoadSound("resources/button_click.wav") });
-        if (!soundEnabled) {
-            for (auto& button : buttons) SetSoundVolume(button.clickSound, 0.0f);
+string FormatMateLine(const vector<MoveCode>& line) {
+    string text;
+    for (MoveCode move : line) text += (text.empty() ? "" : " ") + Position::MoveToUci(move);
+    return text;
+}
+
+// --solve <puzzles.epd> [N] [threads] [node-limit]: solves every puzzle in parallel, one solver and
+// hash table per thread, and reports the solve rate and median time per puzzle. Checks-only
+// refutations are confirmed by a full-width pass before a puzzle counts as having no mate.
+int RunMateSolver(const char* path, int defaultMateIn, int threadCount, uint64_t nodeLimit) {
+    typedef chrono::steady_clock Clock;
+    vector<MatePuzzle> puzzles;
+    if (!LoadMatePuzzles(path, defaultMateIn, puzzles) || puzzles.empty()) {
+        fprintf(stderr, "No puzzles in '%s'\n", path);
+        return 1;
+    }
+    vector<MateSolver::Result> results(puzzles.size());
+    vector<double> milliseconds(puzzles.size());
+    vector<string> lines(puzzles.size());
+    atomic<size_t> nextPuzzle{ 0 };
+    atomic<uint64_t> totalNodes{ 0 };
+    auto start = Clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < max(threadCount, 1); t++) {
+        workers.emplace_back([&] {
+            MateSolver solver;
+            vector<MoveCode> line;
+            for (size_t i; (i = nextPuzzle++) < puzzles.size();) {
+                auto puzzleStart = Clock::now();
+                results[i] = solver.Solve(puzzles[i].position, puzzles[i].mateIn, nodeLimit, line);
+                totalNodes += solver.Nodes();
+                if (results[i] == MateSolver::NO_MATE) {
+                    results[i] = solver.Solve(puzzles[i].position, puzzles[i].mateIn, nodeLimit, line, false);
+                    totalNodes += solver.Nodes();
+                }
+                milliseconds[i] = chrono::duration<double, milli>(Clock::now() - puzzleStart).count();
+                lines[i] = FormatMateLine(line);
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double elapsed = chrono::duration<double>(Clock::now() - start).count();
+    size_t solved = 0, refuted = 0;
+    for (size_t i = 0; i < puzzles.size(); i++) {
+        const char* verdict = results[i] == MateSolver::MATE_FOUND ? "mate" : results[i] == MateSolver::NO_MATE ? "no mate within" : "unknown (node limit), mate in";
+        printf("%s: %s %d%s%s (%.1f ms)\n", puzzles[i].id.c_str(), verdict, puzzles[i].mateIn, lines[i].empty() ? "" : ": ", lines[i].c_str(), milliseconds[i]);
+        solved += results[i] == MateSolver::MATE_FOUND;
+        refuted += results[i] == MateSolver::NO_MATE;
+    }
+    vector<double> sorted = milliseconds;
+    sort(sorted.begin(), sorted.end());
+    printf("Solved %zu/%zu (%.1f%%), proven no mate: %zu, unknown: %zu\n", solved, puzzles.size(), 100.0 * solved / puzzles.size(),
+        refuted, puzzles.size() - solved - refuted);
+    printf("Median %.2f ms per puzzle, %.2f s wall time on %d threads, %.0f nodes/s\n", sorted[sorted.size() / 2], elapsed,
+        max(threadCount, 1), totalNodes / elapsed);
+    return 0;
+}
+
+// Game store written by --build-db: a "CHEESYGM" header with the game count, then per game one
+// result byte (0 white win, 1 draw, 2 black win, 3 unknown), the length of the starting FEN (0 for
+// the standard start), the ply count as uint16, the FEN text and the MoveCodes. Games that start
+// from a FEN tag are stored but not indexed.
+struct PgnShard {
+    vector<uint8_t> store;
+    vector<ExplorerEntry> entries;
+    size_t games = 0, errors = 0, positions = 0;
+};
+
+// Merges two (key, move)-sorted entry lists, summing the counts of matching pairs.
+vector<ExplorerEntry> MergeExplorerEntries(const vector<ExplorerEntry>& a, const vector<ExplorerEntry>& b) {
+    vector<ExplorerEntry> merged;
+    merged.reserve(a.size() + b.size());
+    auto less = [](const ExplorerEntry& x, const ExplorerEntry& y) { return x.key != y.key ? x.key < y.key : x.move < y.move; };
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        const ExplorerEntry& next = j == b.size() || (i < a.size() && !less(b[j], a[i])) ? a[i++] : b[j++];
+        if (!merged.empty() && merged.back().key == next.key && merged.back().move == next.move) {
+            merged.back().games += next.games;
+            merged.back().whiteWins += next.whiteWins;
+            merged.back().draws += next.draws;
         }
+        else merged.push_back(next);
     }
+    return merged;
+}
 
-    void Update() {
-        Vector2 mouse = GetMousePosition();
-        for (auto& button : buttons) {
-            button.isHovered = CheckCollisionPointRec(mouse, button.rect);
-            if (button.isHovered && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
-                if (soundEnabled) PlaySound(button.clickSound);
-                if (button.text == "Play") gameState = GAME;
-                else if (button.text == "Settings") gameState = SETTINGS;
-                else if (button.text == "Achievements") gameState = ACHIEVEMENTS;
-                else if (button.text == "Exit") CloseWindow();
+// Sorts the pending single-game entries, collapses duplicates and folds them into the shard.
+void FlushExplorerEntries(vector<ExplorerEntry>& pending, PgnShard& shard) {
+    sort(pending.begin(), pending.end(), [](const ExplorerEntry& x, const ExplorerEntry& y) { return x.key != y.key ? x.key < y.key : x.move < y.move; });
+    shard.entries = MergeExplorerEntries(shard.entries, pending);
+    pending.clear();
+}
+
+// Parses the games in text[begin, end): tag pairs, then movetext with comments, variations, NAGs
+// and move numbers skipped. A game with an unparsable move is counted as an error and dropped.
+void ParsePgnGames(const string& text, const vector<size_t>& starts, size_t first, size_t last, int plyLimit, PgnShard& shard) {
+    vector<ExplorerEntry> pending;
+    vector<MoveCode> moves;
+    for (size_t g = first; g < last; g++) {
+        size_t pos = starts[g], end = g + 1 < starts.size() ? starts[g + 1] : text.size();
+        Position position;
+        position.SetStartPosition();
+        bool fromStart = true, valid = true;
+        int result = 3;
+        string startFen;
+        moves.clear();
+        while (pos < end && valid) {
+            char c = text[pos];
+            if (isspace((unsigned char)c)) { pos++; continue; }
+            if (c == '[') {
+                size_t close = text.find(']', pos);
+                string tag = text.substr(pos + 1, min(close, end) - pos - 1);
+                size_t quote = tag.find('"');
+                string value = quote == string::npos ? "" : tag.substr(quote + 1, tag.rfind('"') - quote - 1);
+                if (tag.compare(0, 7, "Result ") == 0) result = value == "1-0" ? 0 : value == "1/2-1/2" ? 1 : value == "0-1" ? 2 : 3;
+                else if (tag.compare(0, 4, "FEN ") == 0) {
+                    valid = position.SetFromFEN(value);
+                    fromStart = false;
+                    if (valid) startFen = position.ToFEN();
+                }
+                pos = close == string::npos ? end : close + 1;
+                continue;
+            }
+            if (c == '{') { size_t close = text.find('}', pos); pos = close == string::npos ? end : close + 1; continue; }
+            if (c == ';') { size_t close = text.find('\n', pos); pos = close == string::npos ? end : close + 1; continue; }
+            if (c == '(') {
+                int depth = 0;
+                for (; pos < end; pos++) {
+                    if (text[pos] == '(') depth++;
+                    else if (text[pos] == ')' && --depth == 0) break;
+                    else if (text[pos] == '{') pos = min(text.find('}', pos), end - 1);
+                }
+                pos++;
+                continue;
+            }
+            size_t tokenEnd = pos;
+            while (tokenEnd < end && !isspace((unsigned char)text[tokenEnd]) && !strchr("{}();[", text[tokenEnd])) tokenEnd++;
+            string token = text.substr(pos, max(tokenEnd, pos + 1) - pos);
+            pos = max(tokenEnd, pos + 1);
+            if (token[0] == '$' || token == "*" || token == "1-0" || token == "0-1" || token == "1/2-1/2") continue;
+            if (isdigit((unsigned char)token[0]) && token.compare(0, 3, "0-0") != 0) {
+                size_t dot = token.find_last_of('.');
+                if (dot == string::npos) continue;
+                token.erase(0, dot + 1);
+                if (token.empty()) continue;
             }
+            MoveCode move;
+            if (!position.ParseSan(token, move)) { valid = false; break; }
+            if (fromStart && result < 3 && (int)moves.size() < plyLimit) {
+                ExplorerEntry entry = {};
+                entry.key = position.Key();
+                entry.move = move;
+                entry.games = 1;
+                entry.whiteWins = result == 0;
+                entry.draws = result == 1;
+                pending.push_back(entry);
+            }
+            moves.push_back(move);
+            position.MakeMove(move);
+        }
+        if (!valid || (moves.empty() && result == 3)) {
+            shard.errors += !valid;
+            continue;
         }
+        shard.games++;
+        shard.positions += fromStart && result < 3 ? min((int)moves.size(), plyLimit) : 0;
+        uint16_t plies = (uint16_t)moves.size();
+        shard.store.push_back((uint8_t)result);
+        shard.store.push_back((uint8_t)startFen.size());
+        shard.store.insert(shard.store.end(), (const uint8_t*)&plies, (const uint8_t*)&plies + 2);
+        shard.store.insert(shard.store.end(), startFen.begin(), startFen.end());
+        shard.store.insert(shard.store.end(), (const uint8_t*)moves.data(), (const uint8_t*)(moves.data() + moves.size()));
+        if (pending.size() >= (1u << 22)) FlushExplorerEntries(pending, shard);
     }
+    FlushExplorerEntries(pending, shard);
+}
 
-    void Draw() {
-        ClearBackground(DARKGRAY);
-        for (int i = 0; i < screenWidth; i += 100) {
-            for (int j = 0; j < screenHeight; j += 100) {
-                DrawRectangle(i, j, 50, 50, Color{ 35, 35, 35, 255 });
+// --build-db <games.pgn> [output] [threads] [plies]: splits the PGN into games, parses ranges of
+// games in parallel and writes <output>.bin (game store) and <output>.idx (explorer index) for the
+// first `plies` half-moves of every finished game.
+int RunBuildGameDatabase(const char* pgnPath, const string& output, int threadCount, int plyLimit) {
+    typedef chrono::steady_clock Clock;
+    auto start = Clock::now();
+    FILE* file = fopen(pgnPath, "rb");
+    if (!file) {
+        fprintf(stderr, "Cannot open '%s'\n", pgnPath);
+        return 1;
+    }
+    string text;
+    char buffer[1 << 16];
+    for (size_t read; (read = fread(buffer, 1, sizeof(buffer), file)) > 0;) text.append(buffer, read);
+    fclose(file);
+
+    // A game starts at the first tag line after movetext (or at the start of the file).
+    vector<size_t> starts;
+    bool inMovetext = true;
+    for (size_t pos = 0; pos < text.size();) {
+        size_t lineEnd = text.find('\n', pos);
+        if (lineEnd == string::npos) lineEnd = text.size();
+        size_t first = text.find_first_not_of(" \t\r", pos);
+        if (first < lineEnd) {
+            if (text[first] == '[') {
+                if (inMovetext) starts.push_back(first);
+                inMovetext = false;
             }
+            else inMovetext = true;
         }
-        DrawText("CHEESY CHESS", screenWidth / 2 - 200, 150, 60, GOLD);
-        DrawText("Master the Game", screenWidth / 2 - 120, 220, 24, LIGHTGRAY);
-        for (const auto& button : buttons) {
-            float scale = button.isHovered ? 1.05f : 1.0f;
-            Rectangle scaledRect = {
-                button.rect.x - (button.rect.width * scale - button.rect.width) / 2,
-                button.rect.y - (button.rect.height * scale - button.rect.height) / 2,
-                button.rect.width * scale,
-                button.rect.height * scale
-            };
-            Color currentColor = button.isHovered ? button.hoverColor : button.color;
-            DrawRectanglePro(scaledRect, { 0, 0 }, 0.0f, currentColor);
-            DrawRectangleLinesEx(scaledRect, 2, WHITE);
-            Vector2 textSize = MeasureTextEx(GetFontDefault(), button.text.c_str(), 24, 0);
-            DrawText(button.text.c_str(),
-                scaledRect.x + scaledRect.width / 2 - textSize.x / 2,
-                scaledRect.y + scaledRect.height / 2 - textSize.y / 2,
-                24, WHITE);
+        pos = lineEnd + 1;
+    }
+
+    threadCount = max(1, min(threadCount, (int)starts.size()));
+    vector<PgnShard> shards(threadCount);
+    vector<thread> workers;
+    for (int t = 0; t < threadCount; t++) {
+        size_t first = starts.size() * t / threadCount, last = starts.size() * (t + 1) / threadCount;
+        workers.emplace_back(ParsePgnGames, cref(text), cref(starts), first, last, plyLimit, ref(shards[t]));
+    }
+    for (auto& worker : workers) worker.join();
+    double parseSeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    vector<ExplorerEntry> entries;
+    size_t games = 0, errors = 0, positions = 0;
+    for (PgnShard& shard : shards) {
+        entries = MergeExplorerEntries(entries, shard.entries);
+        shard.entries = vector<ExplorerEntry>();
+        games += shard.games;
+        errors += shard.errors;
+        positions += shard.positions;
+    }
+
+    FILE* store = fopen((output + ".bin").c_str(), "wb");
+    FILE* index = fopen((output + ".idx").c_str(), "wb");
+    if (!store || !index) {
+        fprintf(stderr, "Cannot write '%s.bin' / '%s.idx'\n", output.c_str(), output.c_str());
+        if (store) fclose(store);
+        if (index) fclose(index);
+        return 1;
+    }
+    uint64_t gameCount = games;
+    fwrite("CHEESYGM", 1, 8, store);
+    fwrite(&gameCount, sizeof(gameCount), 1, store);
+    for (const PgnShard& shard : shards) fwrite(shard.store.data(), 1, shard.store.size(), store);
+    fclose(store);
+    ExplorerIndexHeader header = {};
+    memcpy(header.magic, "CHEESYIX", 8);
+    header.entryCount = entries.size();
+    header.plyLimit = (uint32_t)plyLimit;
+    header.fenceStride = GameDatabase::fenceStride;
+    fwrite(&header, sizeof(header), 1, index);
+    fwrite(entries.data(), sizeof(ExplorerEntry), entries.size(), index);
+    for (size_t i = 0; i < entries.size(); i += GameDatabase::fenceStride) fwrite(&entries[i].key, sizeof(uint64_t), 1, index);
+    fclose(index);
+
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    printf("Games: %zu stored, %zu rejected, %zu positions indexed into %zu entries\n", games, errors, positions, entries.size());
+    printf("Parsed in %.2f s on %d threads (%.0f games/s), total %.2f s\n", parseSeconds, threadCount, games / max(parseSeconds, 1e-9), seconds);
+    return 0;
+}
+
+// --explore <fen|startpos> [index]: prints the explorer statistics of a position and the lookup
+// latency over random keys from the index.
+int RunExplorer(const string& fen, const string& indexPath) {
+    typedef chrono::steady_clock Clock;
+    GameDatabase database;
+    if (!database.Open(indexPath)) {
+        fprintf(stderr, "Cannot open index '%s'\n", indexPath.c_str());
+        return 1;
+    }
+    Position position;
+    if (fen == "startpos") position.SetStartPosition();
+    else if (!position.SetFromFEN(fen)) {
+        fprintf(stderr, "Invalid FEN\n");
+        return 1;
+    }
+    if (!database.EntryCount()) {
+        printf("no entries\n");
+        return 0;
+    }
+    vector<ExplorerMove> moves;
+    auto start = Clock::now();
+    uint32_t total = database.Lookup(position.Key(), moves);
+    double lookupUs = chrono::duration<double, micro>(Clock::now() - start).count();
+    printf("%u games from this position (lookup %.1f us)\n", total, lookupUs);
+    for (const ExplorerMove& move : moves) {
+        printf("  %-8s %8u games  white %5.1f%%  draw %5.1f%%  black %5.1f%%\n", position.MoveToSan(move.move).c_str(), move.games,
+            100.0 * move.whiteWins / move.games, 100.0 * move.draws / move.games, 100.0 * (move.games - move.whiteWins - move.draws) / move.games);
+    }
+
+    // Keys of random positions from random playouts, so most lookups miss the cache and many miss the index.
+    mt19937_64 random(7);
+    vector<uint64_t> keys;
+    for (int game = 0; game < 200; game++) {
+        Position walk;
+        walk.SetStartPosition();
+        for (int ply = 0; ply < database.PlyLimit(); ply++) {
+            keys.push_back(walk.Key());
+            MoveCode legal[maxMoves];
+            int count = walk.GenerateLegalMoves(legal);
+            if (!count) break;
+            vector<ExplorerMove> known;
+            database.Lookup(walk.Key(), known);
+            walk.MakeMove(!known.empty() && random() % 4 ? known[random() % known.size()].move : legal[random() % count]);
+        }
+    }
+    vector<double> latencies;
+    for (uint64_t key : keys) {
+        auto lookupStart = Clock::now();
+        database.Lookup(key, moves);
+        latencies.push_back(chrono::duration<double, micro>(Clock::now() - lookupStart).count());
+    }
+    if (latencies.empty()) {
+        printf("%zu entries; no lookups sampled\n", database.EntryCount());
+        return 0;
+    }
+    sort(latencies.begin(), latencies.end());
+    printf("%zu entries; %zu lookups: median %.2f us, p99 %.2f us, max %.2f us\n", database.EntryCount(), latencies.size(),
+        latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back());
+    return 0;
+}
+
+void PrintSearchInfo(const Engine::Report& report) {
+    for (size_t i = 0; i < report.lines.size(); i++) {
+        string pv;
+        for (MoveCode move : report.lines[i].pv) pv += " " + Position::MoveToUci(move);
+        printf("info depth %d multipv %zu score %s nodes %llu time %.0f pv%s\n", report.depth, i + 1, FormatSearchScore(report.lines[i].score).c_str(),
+            (unsigned long long)report.nodes, report.milliseconds, pv.c_str());
+    }
+    fflush(stdout);
+}
+
+// --uci: the subset of the UCI protocol needed to drive the engine from a GUI or script, including
+// "go ponder" / "ponderhit" and the MultiPV option.
+int RunUci() {
+    Engine engine;
+    Position position;
+    position.SetStartPosition();
+    vector<uint64_t> keys(1, position.Key());
+    int multiPv = 1;
+    engine.onIteration = PrintSearchInfo;
+    // The search thread reports here, so the line is written with one call and cannot interleave
+    // with replies from the input loop.
+    engine.onFinish = [](const Engine::Report& report) {
+        string line = "bestmove 0000\n";
+        if (!report.lines.empty()) {
+            const vector<MoveCode>& pv = report.lines[0].pv;
+            line = "bestmove " + Position::MoveToUci(pv[0]);
+            if (pv.size() > 1) line += " ponder " + Position::MoveToUci(pv[1]);
+            line += "\n";
+        }
+        fputs(line.c_str(), stdout);
+        fflush(stdout);
+    };
+    char buffer[8192];
+    while (fgets(buffer, sizeof(buffer), stdin)) {
+        vector<string> tokens;
+        for (char* token = strtok(buffer, " \t\r\n"); token; token = strtok(nullptr, " \t\r\n")) tokens.push_back(token);
+        if (tokens.empty()) continue;
+        const string& command = tokens[0];
+        auto value = [&](const char* name, int fallback) {
+            for (size_t i = 1; i + 1 < tokens.size(); i++) {
+                if (tokens[i] == name) return atoi(tokens[i + 1].c_str());
+            }
+            return fallback;
+        };
+        auto has = [&](const char* name) { return find(tokens.begin(), tokens.end(), name) != tokens.end(); };
+        if (command == "uci") {
+            printf("id name CheesyChess\nid author CheesyChess\n");
+            printf("option name MultiPV type spin default 1 min 1 max 16\noption name Ponder type check default false\nuciok\n");
         }
+        else if (command == "isready") printf("readyok\n");
+        else if (command == "ucinewgame") engine.NewGame();
+        else if (command == "setoption" && tokens.size() >= 5 && tokens[2] == "MultiPV") multiPv = max(1, min(16, atoi(tokens[4].c_str())));
+        else if (command == "position") {
+            engine.Stop();
+            engine.Wait();
+            size_t i = 1;
+            if (i < tokens.size() && tokens[i] == "fen") {
+                string fen;
+                for (i++; i < tokens.size() && tokens[i] != "moves"; i++) fen += tokens[i] + " ";
+                if (!position.SetFromFEN(fen)) position.SetStartPosition();
+            }
+            else {
+                position.SetStartPosition();
+                i++;
+            }
+            keys.assign(1, position.Key());
+            for (i++; i < tokens.size(); i++) {
+                MoveCode move;
+                if (!position.ParseUci(tokens[i], move) || !position.IsLegal(move)) break;
+                position.MakeMove(move);
+                keys.push_back(position.Key());
+            }
+        }
+        else if (command == "go") {
+            Engine::Limits limits;
+            limits.multiPv = multiPv;
+            limits.depth = min(value("depth", maxSearchPly - 1), maxSearchPly - 1);
+            limits.moveTimeMs = value("movetime", 0);
+            int time = value(position.whiteToMove ? "wtime" : "btime", 0), increment = value(position.whiteToMove ? "winc" : "binc", 0);
+            if (time > 0 && limits.moveTimeMs == 0) limits.moveTimeMs = max(10, time / max(value("movestogo", 30), 1) + increment * 3 / 4 - 20);
+            limits.ponder = has("ponder");
+            limits.infinite = has("infinite");
+            engine.Start(position, keys, limits);
+        }
+        else if (command == "ponderhit") engine.PonderHit();
+        else if (command == "stop") engine.Stop();
+        else if (command == "quit") break;
+        fflush(stdout);
     }
+    engine.Stop();
+    engine.Wait();
+    return 0;
+}
 
-    void Unload() {
-        for (auto& button : buttons) UnloadSound(button.clickSound);
-    }
-};
-
-class SettingsScreen {
-private:
-    struct Button {
-        Rectangle rect;
-        string text;
-        Color color;
-        Color hoverColor;
-        bool isHovered = false;
-        Sound clickSound;
+// --bench-search [depth] : searches a fixed set of positions to a fixed depth with the legacy
+// ordering and with the staged move picker, each from an empty table and history, and compares
+// nodes to depth, time and the share of beta cutoffs produced by the first move tried.
+int RunSearchBenchmark(int depth) {
+    static const char* fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        "r1bqkb1r/pp3ppp/2n1pn2/2pp4/3P4/2PBPN2/PP1N1PPP/R1BQK2R b KQkq - 0 6",
+        "2r2rk1/pp1bqppp/2n1pn2/3p4/2PP4/P1N1PN2/1P2BPPP/R2Q1RK1 w - - 0 13",
     };
-    vector<Button> buttons;
+    Engine engine(20);
+    printf("%-8s %12s %10s %12s %14s\n", "ordering", "nodes", "ms", "nodes/s", "first-move cut");
+    uint64_t legacyNodes = 0;
+    for (int staged = 0; staged <= 1; staged++) {
+        uint64_t nodes = 0, cutoffs = 0, firstMoveCutoffs = 0;
+        double ms = 0;
+        for (const char* fen : fens) {
+            Position position;
+            position.SetFromFEN(fen);
+            engine.NewGame();
+            Engine::Limits limits;
+            limits.depth = depth;
+            limits.legacyOrdering = staged == 0;
+            Engine::Report report = engine.Think(position, vector<uint64_t>(), limits);
+            nodes += report.nodes;
+            ms += report.milliseconds;
+            cutoffs += report.cutoffs;
+            firstMoveCutoffs += report.firstMoveCutoffs;
+        }
+        printf("%-8s %12llu %10.0f %12.0f %13.1f%%\n", staged ? "staged" : "legacy", (unsigned long long)nodes, ms, nodes / max(ms / 1000.0, 1e-9),
+            cutoffs ? 100.0 * firstMoveCutoffs / cutoffs : 0.0);
+        if (!staged) legacyNodes = nodes;
+        else printf("Staged ordering searches %.1f%% of the legacy nodes to depth %d\n", legacyNodes ? 100.0 * nodes / legacyNodes : 0.0, depth);
+    }
+    return 0;
+}
 
-public:
-    void Init() {
-        buttons.clear();
-        buttons.push_back({ {screenWidth / 2 - 150, 300, 300, 60}, soundEnabled ? "Sound: On" : "Sound: Off", GREEN, LIME, false, LoadSound("resources/button_click.wav") });
-        buttons.push_back({ {screenWidth / 2 - 150, 380, 300, 60}, colorScheme == 0 ? "Color: Beige/Brown" : "Color: Blue/White", BLUE, SKYBLUE, false, LoadSound("resources/button_click.wav") });
-        buttons.push_back({ {screenWidth / 2 - 150, 460, 300, 60}, "Back", RED, MAROON, false, LoadSound("resources/button_click.wav") });
-        if (!soundEnabled) {
-            for (auto& button : buttons) SetSoundVolume(button.clickSound, 0.0f);
+// --analyze <fen|startpos> [lines] [milliseconds]: multi-PV analysis of one position.
+int RunAnalysis(const string& fen, int multiPv, int moveTimeMs) {
+    Position position;
+    if (fen == "startpos") position.SetStartPosition();
+    else if (!position.SetFromFEN(fen)) {
+        fprintf(stderr, "Invalid FEN\n");
+        return 1;
+    }
+    Engine engine;
+    engine.onIteration = PrintSearchInfo;
+    Engine::Limits limits;
+    limits.multiPv = multiPv;
+    limits.moveTimeMs = moveTimeMs;
+    Engine::Report report = engine.Think(position, vector<uint64_t>(), limits);
+    printf("Depth %d, %llu nodes in %.0f ms\n", report.depth, (unsigned long long)report.nodes, report.milliseconds);
+    for (size_t i = 0; i < report.lines.size(); i++) {
+        Position walk = position;
+        string pv;
+        for (MoveCode move : report.lines[i].pv) {
+            pv += " " + walk.MoveToSan(move);
+            walk.MakeMove(move);
         }
+        printf("%zu. %-9s%s\n", i + 1, FormatSearchScore(report.lines[i].score).c_str(), pv.c_str());
     }
+    return 0;
+}
 
-    void Update() {
-        Vector2 mouse = GetMousePosition();
-        for (auto& button : buttons) {
-            button.isHovered = CheckCollisionPointRec(mouse, button.rect);
-            if (button.isHovered && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
-                if (soundEnabled) PlaySound(button.clickSound);
-                if (button.text.find("Sound") != string::npos) {
-                    soundEnabled = !soundEnabled;
-                    button.text = soundEnabled ? "Sound: On" : "Sound: Off";
-                    for (auto& b : buttons) SetSoundVolume(b.clickSound, soundEnabled ? 1.0f : 0.0f);
+// --ponder-bench [games] [milliseconds]: self-play where one engine ponders and the other does not.
+// On a ponder hit the pondering engine replies as soon as its move time, counted from the start of
+// the ponder search, is used up; the report compares its reply times with and without a hit.
+int RunPonderBenchmark(int games, int moveTimeMs) {
+    typedef chrono::steady_clock Clock;
+    Engine ponderer(18), opponent(18);
+    Engine::Limits limits;
+    limits.moveTimeMs = moveTimeMs;
+    Engine::Limits ponderLimits = limits;
+    ponderLimits.ponder = true;
+    int hits = 0, misses = 0, searches = 0;
+    double hitMs = 0, searchMs = 0;
+    mt19937 random(5);
+    for (int game = 0; game < games; game++) {
+        Position position;
+        position.SetStartPosition();
+        vector<uint64_t> keys(1, position.Key());
+        // A couple of random opening moves so the games differ.
+        for (int ply = 0; ply < 2; ply++) {
+            MoveCode moves[maxMoves];
+            position.MakeMove(moves[random() % position.GenerateLegalMoves(moves)]);
+            keys.push_back(position.Key());
+        }
+        ponderer.NewGame();
+        opponent.NewGame();
+        bool pondererWhite = game % 2 == 0;
+        uint64_t ponderKey = 0;
+        GameStatus status;
+        status.Compute(position, keys.data(), (int)keys.size(), false);
+        for (int ply = 0; ply < 160 && !status.IsOver(); ply++) {
+            Engine::Report report;
+            if (position.whiteToMove == pondererWhite) {
+                auto start = Clock::now();
+                bool hit = ponderer.Running() && position.Key() == ponderKey;
+                if (hit) ponderer.PonderHit();
+                else ponderer.Start(position, keys, limits);
+                report = ponderer.Wait();
+                double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+                if (hit) {
+                    hits++;
+                    hitMs += ms;
                 }
-                else if (button.text.find("Color") != string::npos) {
-                    colorScheme = (colorScheme + 1) % 2;
-                    button.text = colorScheme == 0 ? "Color: Beige/Brown" : "Color: Blue/White";
+                else {
+                    misses += ponderKey != 0;
+                    searches++;
+                    searchMs += ms;
                 }
-                else if (button.text == "Back") gameState = MENU;
+                ponderKey = 0;
+            }
+            else report = opponent.Think(position, keys, limits);
+            if (report.lines.empty()) break;
+            const vector<MoveCode>& pv = report.lines[0].pv;
+            position.MakeMove(pv[0]);
+            keys.push_back(position.Key());
+            status.Compute(position, keys.data(), (int)keys.size(), false);
+            if (position.whiteToMove != pondererWhite && pv.size() > 1 && position.IsLegal(pv[1]) && !status.IsOver()) {
+                Position predicted = position;
+                predicted.MakeMove(pv[1]);
+                vector<uint64_t> predictedKeys = keys;
+                predictedKeys.push_back(predicted.Key());
+                ponderKey = predicted.Key();
+                ponderer.Start(predicted, predictedKeys, ponderLimits);
             }
         }
-        if (IsKeyPressed(KEY_ESCAPE)) gameState = MENU;
+        ponderer.Stop();
+        ponderer.Wait();
+        printf("Game %d: %d plies, %s\n", game + 1, (int)keys.size() - 1, status.Name());
     }
+    double normalMs = searches ? searchMs / searches : moveTimeMs;
+    double averageHitMs = hits ? hitMs / hits : 0;
+    printf("Ponder hits: %d, misses: %d (hit rate %.1f%%)\n", hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+    printf("Reply time: %.1f ms without a hit, %.1f ms after a hit\n", normalMs, averageHitMs);
+    double saved = hits * (normalMs - averageHitMs);
+    printf("Thinking time saved: %.2f s of %.2f s (%.1f%%)\n", saved / 1000.0, (searchMs + hitMs + saved) / 1000.0,
+        searchMs + hitMs + saved > 0 ? 100.0 * saved / (searchMs + hitMs + saved) : 0.0);
+    return 0;
+}
 
-    void Draw() {
-        ClearBackground(DARKGRAY);
-        DrawText("Settings", screenWidth / 2 - 100, 150, 40, WHITE);
-        for (const auto& button : buttons) {
-            float scale = button.isHovered ? 1.05f : 1.0f;
-            Rectangle scaledRect = {
-                button.rect.x - (button.rect.width * scale - button.rect.width) / 2,
-                button.rect.y - (button.rect.height * scale - button.rect.height) / 2,
-                button.rect.width * scale,
-                button.rect.height * scale
-            };
-            Color currentColor = button.isHovered ? button.hoverColor : button.color;
-            DrawRectanglePro(scaledRect, { 0, 0 }, 0.0f, currentColor);
-            DrawRectangleLinesEx(scaledRect, 2, WHITE);
-            Vector2 textSize = MeasureTextEx(GetFontDefault(), button.text.c_str(), 24, 0);
-            DrawText(button.text.c_str(),
-                scaledRect.x + scaledRect.width / 2 - textSize.x / 2,
-                scaledRect.y + scaledRect.height / 2 - textSize.y / 2,
-                24, WHITE);
+// Headless multi-game server. One epoll thread owns the sockets and routes each command line to the
+// worker shard that owns the game (game id % shard count), so game state is only touched by one
+// thread and needs no locking. Shards keep positions and move history in their own block arenas.
+//
+// Protocol (one command per line, replies are single lines):
+//   new [fen]            -> game <id>
+//   join <id>            -> joined <id> <fen>     (receives "update" lines for the opponent's moves)
+//   move <id> <uci>      -> ok <id> <uci> <status> | illegal <id> <uci> | error <id> <reason>
+//   fen <id>             -> fen <id> <fen>
+//   history <id>         -> history <id> <uci>...
+//   close <id>           -> closed <id>
+//   stats                -> stats games=<n> moves=<n> rejected=<n> connections=<n>
+// <status> is one of ongoing, check, checkmate, stalemate, draw-fifty, draw-repetition, draw-material.
+// Only the creator may close a game, and only the creator and the joined player may move in it.
+// Games still open when the connection that created them drops are closed. A client that
+// half-closes its socket still gets replies to every command it sent before the close.
+#ifdef __linux__
+
+// Hands out fixed-size blocks carved from large chunks; released blocks are reused first.
+class BlockArena {
+private:
+    size_t blockSize;
+    size_t chunkBytes;
+    vector<unique_ptr<char[]>> chunks;
+    char* cursor = nullptr;
+    size_t remaining = 0;
+    void* freeList = nullptr;
+
+public:
+    BlockArena(size_t size, size_t blocksPerChunk = 4096)
+        : blockSize((max(size, sizeof(void*)) + 15) & ~(size_t)15), chunkBytes(blockSize * blocksPerChunk) {}
+
+    void* Allocate() {
+        if (freeList) {
+            void* block = freeList;
+            freeList = *(void**)block;
+            return block;
         }
-        DrawText("Press ESC to go back", 50, screenHeight - 50, 20, GRAY);
+        if (remaining < blockSize) {
+            chunks.emplace_back(new char[chunkBytes]);
+            cursor = chunks.back().get();
+            remaining = chunkBytes;
+        }
+        void* block = cursor;
+        cursor += blockSize;
+        remaining -= blockSize;
+        return block;
     }
 
-    void Unload() {
-        for (auto& button : buttons) UnloadSound(button.clickSound);
+    void Release(void* block) {
+        *(void**)block = freeList;
+        freeList = block;
     }
 };
 
-class AchievementsScreen {
+// Moves and the Zobrist key of the position after each of them, for repetition detection.
+struct HistoryBlock {
+    static const int capacity = 12;
+    MoveCode moves[capacity];
+    uint64_t keys[capacity];
+    HistoryBlock* next = nullptr;
+};
+
+struct ServerGame {
+    Position position;
+    uint64_t startKey = 0;
+    uint32_t id = 0;
+    uint16_t plies = 0;
+    PlayStatus status = PLAY_ONGOING;
+    int watchers[2] = { -1, -1 }; // connection ids of the creator and the joined player
+    HistoryBlock* firstBlock = nullptr;
+    HistoryBlock* lastBlock = nullptr;
+};
+
+// Opens a listening ("tcp:host:port", "unix:path") or connected socket. Port 0 picks a free port.
+int OpenSocket(const string& address, bool listening, int* boundPort = nullptr) {
+    int fd = -1;
+    if (address.compare(0, 5, "unix:") == 0) {
+        string path = address.substr(5);
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) return -1;
+        strcpy(addr.sun_path, path.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (listening) unlink(path.c_str());
+        int rc = listening ? ::bind(fd, (sockaddr*)&addr, sizeof(addr)) : connect(fd, (sockaddr*)&addr, sizeof(addr));
+        if (rc < 0 || (listening && listen(fd, 1024) < 0)) { close(fd); return -1; }
+        return fd;
+    }
+    string hostPort = address.compare(0, 4, "tcp:") == 0 ? address.substr(4) : address;
+    size_t colon = hostPort.rfind(':');
+    string host = colon == string::npos ? "127.0.0.1" : hostPort.substr(0, colon);
+    int port = atoi(colon == string::npos ? hostPort.c_str() : hostPort.c_str() + colon + 1);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) return -1;
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (listening) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0) { close(fd); return -1; }
+        socklen_t len = sizeof(addr);
+        getsockname(fd, (sockaddr*)&addr, &len);
+        if (boundPort) *boundPort = ntohs(addr.sin_port);
+    }
+    else if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) { close(fd); return -1; }
+    return fd;
+}
+
+class GameServer {
 private:
-    vector<Achievement> achievements;
-    struct Button {
-        Rectangle rect;
-        string text;
-        Color color;
-        Color hoverColor;
-        bool isHovered = false;
-        Sound clickSound;
+    struct Connection {
+        int fd = -1;
+        int id = 0;
+        string inbox;
+        mutex outMutex;
+        string outbox;
+        bool flushQueued = false; // guarded by outMutex
+        bool wantWrite = false;   // event loop only
+        vector<uint32_t> games;   // event loop only: games created here and not yet closed
+        bool peerClosed = false;  // event loop only: the client sent EOF
+        atomic<int> drainingShards{ 0 }; // shards yet to reach the end-of-input marker
     };
-    Button backButton;
+
+    struct ServerCommand {
+        int connection;
+        string line;
+    };
+
+    struct Shard {
+        mutex queueMutex;
+        condition_variable queueReady;
+        deque<ServerCommand> queue;
+        BlockArena gameArena{ sizeof(ServerGame) };
+        BlockArena historyArena{ sizeof(HistoryBlock) };
+        unordered_map<uint32_t, ServerGame*> games;
+        vector<uint64_t> recentKeys;
+        GameStatus status;
+        thread worker;
+    };
+
+    static const uint64_t listenToken = 0, wakeToken = 1;
+
+    int listenFd = -1, epollFd = -1, wakeFd = -1;
+    int port = 0;
+    atomic<bool> running{ false };
+    atomic<uint32_t> nextGameId{ 1 };
+    int nextConnectionId = 2;
+    vector<unique_ptr<Shard>> shards;
+    mutex connectionsMutex;
+    unordered_map<int, shared_ptr<Connection>> connections;
+    mutex flushMutex;
+    vector<int> flushQueue;
 
 public:
-    void Init(vector<Achievement>& ach) {
-        achievements = ach;
-        backButton = { {screenWidth / 2 - 150, screenHeight - 100, 300, 60}, "Back", RED, MAROON, false, LoadSound("resources/button_click.wav") };
-        if (!soundEnabled) SetSoundVolume(backButton.clickSound, 0.0f);
+    atomic<uint64_t> gamesCreated{ 0 }, movesValidated{ 0 }, movesRejected{ 0 };
+
+    ~GameServer() {
+        Stop();
+        if (listenFd >= 0) close(listenFd);
+        if (epollFd >= 0) close(epollFd);
+        if (wakeFd >= 0) close(wakeFd);
     }
 
-    void Update() {
-        Vector2 mouse = GetMousePosition();
-        backButton.isHovered = CheckCollisionPointRec(mouse, backButton.rect);
-        if (backButton.isHovered && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
-            if (soundEnabled) PlaySound(backButton.clickSound);
-            gameState = MENU;
-        }
-        if (IsKeyPressed(KEY_ESCAPE)) gameState = MENU;
+    bool Start(const string& address, int workerCount) {
+        listenFd = OpenSocket(address, true, &port);
+        if (listenFd < 0) return false;
+        fcntl(listenFd, F_SETFL, O_NONBLOCK);
+        epollFd = epoll_create1(0);
+        wakeFd = eventfd(0, EFD_NONBLOCK);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = listenToken;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+        ev.data.u64 = wakeToken;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+        running = true;
+        for (int i = 0; i < max(workerCount, 1); i++) shards.emplace_back(new Shard());
+        for (size_t i = 0; i < shards.size(); i++) shards[i]->worker = thread(&GameServer::WorkerLoop, this, (int)i);
+        return true;
     }
 
-    void Draw() {
-        ClearBackground(DARKGRAY);
-        DrawText("Achievements", screenWidth / 2 - 120, 100, 40, WHITE);
-        int y = 150;
-        for (const auto& ach : achievements) {
-            string text = ach.name + (ach.unlocked ? " (Unlocked)" : " (Locked)");
-            Color color = ach.unlocked ? GREEN : GRAY;
-            DrawText(text.c_str(), screenWidth / 2 - 200, y, 20, color);
-            DrawText(ach.description.c_str(), screenWidth / 2 - 200, y + 25, 16, LIGHTGRAY);
-            y += 60;
+    int Port() const { return port; }
+
+    void Stop() {
+        if (!running.exchange(false)) return;
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {}
+        for (auto& shard : shards) {
+            { lock_guard<mutex> lock(shard->queueMutex); }
+            shard->queueReady.notify_all();
+            shard->worker.join();
         }
-        float scale = backButton.isHovered ? 1.05f : 1.0f;
-        Rectangle scaledRect = {
-            backButton.rect.x - (backButton.rect.width * scale - backButton.rect.width) / 2,
-            backButton.rect.y - (backButton.rect.height * scale - backButton.rect.height) / 2,
-            backButton.rect.width * scale,
-            backButton.rect.height * scale
-        };
-        DrawRectanglePro(scaledRect, { 0, 0 }, 0.0f, backButton.isHovered ? backButton.hoverColor : backButton.color);
-        DrawRectangleLinesEx(scaledRect, 2, WHITE);
-        Vector2 textSize = MeasureTextEx(GetFontDefault(), backButton.text.c_str(), 24, 0);
-        DrawText(backButton.text.c_str(),
-            scaledRect.x + scaledRect.width / 2 - textSize.x / 2,
-            scaledRect.y + scaledRect.height / 2 - textSize.y / 2,
-            24, WHITE);
-        DrawText("Press ESC to go back", 50, screenHeight - 50, 20, GRAY);
     }
 
-    void Unload() {
-        UnloadSound(backButton.clickSound);
+    // Event loop; returns after Stop().
+    void Run() {
+        epoll_event events[256];
+        while (running) {
+            int n = epoll_wait(epollFd, events, 256, 100);
+            for (int i = 0; i < n; i++) {
+                uint64_t token = events[i].data.u64;
+                if (token == listenToken) AcceptConnections();
+                else if (token == wakeToken) FlushQueued();
+                else {
+                    shared_ptr<Connection> connection = FindConnection((int)token);
+                    if (!connection) continue;
+                    if (events[i].events & (EPOLLERR | EPOLLHUP)) { CloseConnection(connection); continue; }
+                    if ((events[i].events & EPOLLIN) && !ReadConnection(connection)) { CloseConnection(connection); continue; }
+                    if (events[i].events & EPOLLOUT) Flush(connection);
+                }
+            }
+        }
+        lock_guard<mutex> lock(connectionsMutex);
+        for (auto& entry : connections) close(entry.second->fd);
+        connections.clear();
     }
-};
 
-class Board {
-public:
-    void Draw() {
-        DrawRectangle(boardOffsetX - 10, boardOffsetY - 10, boardSize + 20, boardSize + 20, DARKBROWN);
-        for (int i = 0; i < 8; i++) {
-            for (int j = 0; j < 8; j++) {
-                Color color = ((i + j) % 2 == 0) ?
-                    (colorScheme == 0 ? BEIGE : WHITE) :
-                    (colorScheme == 0 ? BROWN : BLUE);
-                DrawRectangle(boardOffsetX + i * squareSize, boardOffsetY + j * squareSize, squareSize, squareSize, color);
-            }
+    // Thread-safe: queues a reply and wakes the event loop to write it.
+    void Send(int connectionId, const string& text) {
+        shared_ptr<Connection> connection = FindConnection(connectionId);
+        if (!connection) return;
+        bool queue;
+        {
+            lock_guard<mutex> lock(connection->outMutex);
+            connection->outbox += text;
+            queue = !connection->flushQueued;
+            connection->flushQueued = true;
         }
-        for (int i = 0; i < 8; i++) {
-            char file = 'a' + i;
-            DrawText(TextFormat("%c", file), boardOffsetX + i * squareSize + squareSize / 2 - 5, boardOffsetY + boardSize + 5, 16, DARKGRAY);
-            char rank = '8' - i;
-            DrawText(TextFormat("%c", rank), boardOffsetX - 20, boardOffsetY + i * squareSize + squareSize / 2 - 8, 16, DARKGRAY);
+        if (!queue) return;
+        {
+            lock_guard<mutex> lock(flushMutex);
+            flushQueue.push_back(connectionId);
         }
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {}
     }
-};
 
-class ChessGame {
 private:
-    Board board;
-    Piece pieces[32] = {};
-    int selectedPiece = -1;
-    bool whiteTurn = true;
-    string gameStatus = "White to move";
-    int moveCount = 0;
-    Sound moveSound;
-    int promotionPieceIndex = -1;
-    vector<Rectangle> promotionButtons;
-    vector<PieceType> promotionOptions = { QUEEN, ROOK, KNIGHT, BISHOP };
-    vector<Move> moveHistory;
-    vector<Achievement> achievements;
-    int movesWithoutCapture = 0;
-    bool gameEnded = false;
-    int lastPawnDoubleMoveTurn = -1;
-    int enPassantTargetX = -1, enPassantTargetY = -1;
+    shared_ptr<Connection> FindConnection(int id) {
+        lock_guard<mutex> lock(connectionsMutex);
+        auto it = connections.find(id);
+        return it == connections.end() ? nullptr : it->second;
+    }
 
-public:
-    void Init() {
-        int index = 0;
-        const PieceType backRow[] = { ROOK, KNIGHT, BISHOP, QUEEN, KING, BISHOP, KNIGHT, ROOK };
-        moveSound = LoadSound("resources/move.wav");
-        if (!soundEnabled) SetSoundVolume(moveSound, 0.0f);
-        for (int i = 0; i < 8; i++) {
-            pieces[index++] = CreatePiece(backRow[i], i, 7, true);
-            pieces[index++] = CreatePiece(PAWN, i, 6, true);
-            pieces[index++] = CreatePiece(backRow[i], i, 0, false);
-            pieces[index++] = CreatePiece(PAWN, i, 1, false);
+    void AcceptConnections() {
+        for (;;) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+            if (fd < 0) return;
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            shared_ptr<Connection> connection = make_shared<Connection>();
+            connection->fd = fd;
+            connection->id = nextConnectionId++;
+            {
+                lock_guard<mutex> lock(connectionsMutex);
+                connections[connection->id] = connection;
+            }
+            epoll_event ev = {};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.u64 = (uint64_t)connection->id;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
         }
-        whiteTurn = true;
-        selectedPiece = -1;
-        promotionPieceIndex = -1;
-        gameStatus = "White to move";
-        moveCount = 0;
-        moveHistory.clear();
-        movesWithoutCapture = 0;
-        gameEnded = false;
-        lastPawnDoubleMoveTurn = -1;
-        enPassantTargetX = -1;
-        enPassantTargetY = -1;
-        achievements.clear();
-        achievements.push_back(Achievement("Marshall Defense", "Play 1. d4 d5 2. c4 Nf6 3. cxd5 Nxd5 4. e4 Nf6 5. Nc3 e6"));
-        achievements.push_back(Achievement("Italian Game", "Play 1. e4 e5 2. Nf3 Nc6 3. Bc4"));
-        achievements.push_back(Achievement("Sicilian Defense", "Play 1. e4 c5"));
-        achievements.push_back(Achievement("First Checkmate", "Win a game by checkmate"));
-        achievements.push_back(Achievement("Speedy Victory", "Win a game in under 10 moves"));
-        achievements.push_back(Achievement("Pacifist", "Complete 10 moves without capturing"));
-        achievements.push_back(Achievement("Pawn Power", "Promote a pawn to a queen"));
     }
 
-    Piece CreatePiece(PieceType type, int x, int y, bool isWhite) {
-        Piece piece;
-        piece.x = x;
-        piece.y = y;
-        piece.isWhite = isWhite;
-        piece.active = true;
-        piece.type = type;
-        piece.hasMoved = false;
-        return piece;
+    void CloseConnection(const shared_ptr<Connection>& connection) {
+        // The owning shards free the games; connection -1 has nobody to reply to.
+        for (uint32_t gameId : connection->games) Enqueue(gameId, { -1, "close " + to_string(gameId) });
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+        close(connection->fd);
+        lock_guard<mutex> lock(connectionsMutex);
+        connections.erase(connection->id);
     }
 
-    bool IsValidMove(int fromIndex, int toX, int toY) {
-        if (toX < 0 || toX >= 8 || toY < 0 || toY >= 8 || gameEnded) return false;
-        Piece& piece = pieces[fromIndex];
-        if (piece.isWhite != whiteTurn) return false;
-
-        // Check if destination has same color piece
-        for (int i = 0; i < 32; i++) {
-            if (pieces[i].active && pieces[i].x == toX && pieces[i].y == toY && pieces[i].isWhite == piece.isWhite) {
+    // Returns false when the connection failed and should be closed. On EOF the buffered lines are
+    // still dispatched and the connection is drained instead.
+    bool ReadConnection(const shared_ptr<Connection>& connection) {
+        char buffer[16384];
+        bool eof = false;
+        for (;;) {
+            ssize_t n = read(connection->fd, buffer, sizeof(buffer));
+            if (n == 0) { eof = true; break; }
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
                 return false;
             }
+            connection->inbox.append(buffer, (size_t)n);
         }
-
-        int dx = toX - piece.x;
-        int dy = toY - piece.y;
-
-        switch (piece.type) {
-        case PAWN:
-            if (piece.isWhite) {
-                if (dx == 0 && dy == -1 && !IsPieceAt(toX, toY)) return true;
-                if (dx == 0 && dy == -2 && !piece.hasMoved && !IsPieceAt(toX, toY) && !IsPieceAt(toX, toY + 1)) return true;
-                if (dy == -1 && abs(dx) == 1 && IsOpponentPieceAt(toX, toY, piece.isWhite)) return true;
-                if (dy == -1 && abs(dx) == 1 && toX == enPassantTargetX && toY == enPassantTargetY && lastPawnDoubleMoveTurn == moveCount) return true;
-            }
-            else {
-                if (dx == 0 && dy == 1 && !IsPieceAt(toX, toY)) return true;
-                if (dx == 0 && dy == 2 && !piece.hasMoved && !IsPieceAt(toX, toY) && !IsPieceAt(toX, toY - 1)) return true;
-                if (dy == 1 && abs(dx) == 1 && IsOpponentPieceAt(toX, toY, piece.isWhite)) return true;
-                if (dy == 1 && abs(dx) == 1 && toX == enPassantTargetX && toY == enPassantTargetY && lastPawnDoubleMoveTurn == moveCount) return true;
-            }
-            return false;
-        case ROOK:
-            return (dx == 0 || dy == 0) && IsPathClear(piece.x, piece.y, toX, toY);
-        case KNIGHT:
-            return (abs(dx) == 2 && abs(dy) == 1) || (abs(dx) == 1 && abs(dy) == 2);
-        case BISHOP:
-            return (abs(dx) == abs(dy)) && IsPathClear(piece.x, piece.y, toX, toY);
-        case QUEEN:
-            return (dx == 0 || dy == 0 || abs(dx) == abs(dy)) && IsPathClear(piece.x, piece.y, toX, toY);
-        case KING:
-            if (abs(dx) <= 1 && abs(dy) <= 1) return true;
-            // Castling
-            if (!piece.hasMoved && dy == 0 && abs(dx) == 2 && !IsInCheck(piece.isWhite)) {
-                int rookX = dx > 0 ? 7 : 0;
-                int rookIndex = -1;
-                for (int i = 0; i < 32; i++) {
-                    if (pieces[i].active && pieces[i].type == ROOK && pieces[i].x == rookX && pieces[i].y == piece.y && !pieces[i].hasMoved) {
-                        rookIndex = i;
-                        break;
-                    }
-                }
-                if (rookIndex == -1) return false;
-                if (!IsPathClear(piece.x, piece.y, rookX, piece.y)) return false;
-                int kingStep = dx > 0 ? 1 : -1;
-                for (int x = piece.x + kingStep; x != toX + kingStep; x += kingStep) {
-                    Piece tempKing = piece;
-                    tempKing.x = x;
-                    pieces[fromIndex] = tempKing;
-                    if (IsInCheck(piece.isWhite)) {
-                        pieces[fromIndex] = piece;
-                        return false;
-                    }
-                    pieces[fromIndex] = piece;
-                }
-                return true;
-            }
-            return false;
+        size_t start = 0, end;
+        while ((end = connection->inbox.find('\n', start)) != string::npos) {
+            string line = connection->inbox.substr(start, end - start);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            Dispatch(*connection, line);
+            start = end + 1;
         }
-        return false;
+        connection->inbox.erase(0, start);
+        if (eof) DrainConnection(connection);
+        return true;
     }
 
-    bool IsPieceAt(int x, int y) {
-        for (int i = 0; i < 32; i++) {
-            if (pieces[i].active && pieces[i].x == x && pieces[i].y == y) return true;
+    // Stops reading and sends an empty end-of-input marker through every shard. Shard queues are
+    // FIFO, so once every shard has passed its marker all replies are in the outbox, and Flush
+    // closes the connection when the outbox is written.
+    void DrainConnection(const shared_ptr<Connection>& connection) {
+        connection->peerClosed = true;
+        connection->drainingShards = (int)shards.size();
+        epoll_event ev = {};
+        ev.events = connection->wantWrite ? (uint32_t)EPOLLOUT : 0;
+        ev.data.u64 = (uint64_t)connection->id;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &ev);
+        for (auto& shard : shards) {
+            {
+                lock_guard<mutex> lock(shard->queueMutex);
+                shard->queue.push_back({ connection->id, "" });
+            }
+            shard->queueReady.notify_one();
         }
-        return false;
     }
 
-    bool IsOpponentPieceAt(int x, int y, bool isWhite) {
-        for (int i = 0; i < 32; i++) {
-            if (pieces[i].active && pieces[i].x == x && pieces[i].y == y && pieces[i].isWhite != isWhite) return true;
+    void FlushQueued() {
+        uint64_t count;
+        if (read(wakeFd, &count, sizeof(count)) < 0) {}
+        vector<int> pending;
+        {
+            lock_guard<mutex> lock(flushMutex);
+            pending.swap(flushQueue);
+        }
+        for (int id : pending) {
+            shared_ptr<Connection> connection = FindConnection(id);
+            if (connection) Flush(connection);
         }
-        return false;
     }
 
-    bool IsPathClear(int fromX, int fromY, int toX, int toY) {
-        int dx = toX - fromX;
-        int dy = toY - fromY;
-        int steps = std::max(abs(dx), abs(dy));
-        if (steps == 0) return true;
-        int stepX = dx == 0 ? 0 : dx / abs(dx);
-        int stepY = dy == 0 ? 0 : dy / abs(dy);
-        for (int i = 1; i < steps; i++) {
-            if (IsPieceAt(fromX + i * stepX, fromY + i * stepY)) return false;
+    void Flush(const shared_ptr<Connection>& connection) {
+        bool blocked = false;
+        {
+            lock_guard<mutex> lock(connection->outMutex);
+            connection->flushQueued = false;
+            size_t written = 0;
+            while (written < connection->outbox.size()) {
+                ssize_t n = send(connection->fd, connection->outbox.data() + written, connection->outbox.size() - written, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    blocked = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+                    break;
+                }
+                written += (size_t)n;
+            }
+            connection->outbox.erase(0, written);
+        }
+        if (connection->peerClosed && connection->drainingShards == 0 && !blocked) {
+            CloseConnection(connection);
+            return;
+        }
+        if (blocked != connection->wantWrite) {
+            connection->wantWrite = blocked;
+            epoll_event ev = {};
+            ev.events = (connection->peerClosed ? 0 : EPOLLIN | EPOLLRDHUP) | (blocked ? (uint32_t)EPOLLOUT : 0);
+            ev.data.u64 = (uint64_t)connection->id;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &ev);
         }
-        return true;
     }
 
-    bool IsInCheck(bool isWhite) {
-        int kingIndex = -1;
-        for (int i = 0; i < 32; i++) {
-            if (pieces[i].active && pieces[i].type == KING && pieces[i].isWhite == isWhite) {
-                kingIndex = i;
-                break;
+    void Dispatch(Connection& connection, const string& line) {
+        int connectionId = connection.id;
+        char verb[16] = {};
+        unsigned int gameId = 0;
+        int fields = sscanf(line.c_str(), "%15s %u", verb, &gameId);
+        if (fields < 1) return;
+        string command = verb;
+        if (command == "stats") {
+            size_t open;
+            {
+                lock_guard<mutex> lock(connectionsMutex);
+                open = connections.size();
             }
+            Send(connectionId, "stats games=" + to_string(gamesCreated.load()) + " moves=" + to_string(movesValidated.load()) +
+                " rejected=" + to_string(movesRejected.load()) + " connections=" + to_string(open) + "\n");
+            return;
         }
-        if (kingIndex == -1) return false;
-        for (int i = 0; i < 32; i++) {
-            if (pieces[i].active && pieces[i].isWhite != isWhite) {
-                if (IsValidMove(i, pieces[kingIndex].x, pieces[kingIndex].y)) return true;
-            }
+        if (command == "new") {
+            // The event loop assigns the id so the game's shard is known before it exists.
+            gameId = nextGameId++;
+            connection.games.push_back(gameId);
+            Enqueue(gameId, { connectionId, "new " + to_string(gameId) + line.substr(3) });
+            return;
         }
-        return false;
+        if (fields < 2) {
+            Send(connectionId, "error 0 bad-command\n");
+            return;
+        }
+        if (command == "close") connection.games.erase(remove(connection.games.begin(), connection.games.end(), gameId), connection.games.end());
+        Enqueue(gameId, { connectionId, line });
     }
 
-    bool IsCheckmate(bool isWhite) {
-        if (!IsInCheck(isWhite)) return false;
-        for (int i = 0; i < 32; i++) {
-            if (pieces[i].active && pieces[i].isWhite == isWhite) {
-                int fromX = pieces[i].x, fromY = pieces[i].y;
-                for (int x = 0; x < 8; x++) {
-                    for (int y = 0; y < 8; y++) {
-                        if (IsValidMove(i, x, y) && IsLegalMove(i, x, y)) return false;
-                    }
-                }
-            }
+    void Enqueue(uint32_t gameId, ServerCommand command) {
+        Shard& shard = *shards[gameId % shards.size()];
+        {
+            lock_guard<mutex> lock(shard.queueMutex);
+            shard.queue.push_back(std::move(command));
         }
-        return true;
+        shard.queueReady.notify_one();
     }
 
-    bool IsStalemate(bool isWhite) {
-        if (IsInCheck(isWhite)) return false; 
-
-        for (int i = 0; i < 32; i++) {
-            if (pieces[i].active && pieces[i].isWhite == isWhite) {
-                int fromX = pieces[i].x, fromY = pieces[i].y;
-                for (int x = 0; x < 8; x++) {
-                    for (int y = 0; y < 8; y++) {
-                        if (IsValidMove(i, x, y) && IsLegalMove(i, x, y)) {
-                            return false;  // Found at least one legal move
-                        }
-                    }
+    void WorkerLoop(int shardIndex) {
+        Shard& shard = *shards[shardIndex];
+        deque<ServerCommand> batch;
+        for (;;) {
+            {
+                unique_lock<mutex> lock(shard.queueMutex);
+                shard.queueReady.wait(lock, [&] { return !shard.queue.empty() || !running; });
+                if (!running) break;
+                batch.swap(shard.queue);
+            }
+            for (const ServerCommand& command : batch) {
+                if (!command.line.empty()) Execute(shard, command);
+                else if (shared_ptr<Connection> connection = FindConnection(command.connection)) {
+                    // End-of-input marker: the last shard to pass it wakes Flush to close the connection.
+                    if (--connection->drainingShards == 0) Send(command.connection, "");
                 }
             }
+            batch.clear();
         }
-        return true;  // No legal moves found
+        for (auto& entry : shard.games) FreeGame(shard, entry.second);
+        shard.games.clear();
     }
 
-    bool IsLegalMove(int pieceIndex, int toX, int toY) {
-        Piece temp = pieces[pieceIndex];
-        bool captured = false;
-        int capturedIndex = -1;
-        PieceType capturedType = NONE;
-        for (int i = 0; i < 32; i++) {
-            if (pieces[i].active && pieces[i].x == toX && pieces[i].y == toY) {
-                captured = true;
-                capturedIndex = i;
-                capturedType = pieces[i].type;
-                pieces[i].active = false;
-            }
+    void FreeGame(Shard& shard, ServerGame* game) {
+        for (HistoryBlock* block = game->firstBlock; block;) {
+            HistoryBlock* next = block->next;
+            shard.historyArena.Release(block);
+            block = next;
         }
-        bool isEnPassant = (pieces[pieceIndex].type == PAWN && toX == enPassantTargetX && toY == enPassantTargetY && lastPawnDoubleMoveTurn == moveCount);
-        int enPassantCapturedIndex = -1;
-        if (isEnPassant) {
-            int capturedPawnY = pieces[pieceIndex].isWhite ? toY + 1 : toY - 1;
-            for (int i = 0; i < 32; i++) {
-                if (pieces[i].active && pieces[i].x == toX && pieces[i].y == capturedPawnY) {
-                    capturedIndex = i;
-                    capturedType = pieces[i].type;
-                    pieces[i].active = false;
-                    enPassantCapturedIndex = i;
-                    break;
-                }
+        game->~ServerGame();
+        shard.gameArena.Release(game);
+    }
+
+    // Keys of the positions since the last capture or pawn move, the current position last.
+    static void CollectRecentKeys(const ServerGame& game, vector<uint64_t>& keys) {
+        keys.clear();
+        int first = max(0, (int)game.plies - (int)game.position.halfmoveClock);
+        if (first == 0) keys.push_back(game.startKey);
+        int ply = 1;
+        for (HistoryBlock* block = game.firstBlock; block; block = block->next) {
+            for (int i = 0; i < HistoryBlock::capacity && ply <= game.plies; i++, ply++) {
+                if (ply >= first) keys.push_back(block->keys[i]);
             }
         }
-        pieces[pieceIndex].x = toX;
-        pieces[pieceIndex].y = toY;
-        bool inCheck = IsInCheck(pieces[pieceIndex].isWhite);
-        pieces[pieceIndex] = temp;
-        if (captured) pieces[capturedIndex].active = true;
-        if (isEnPassant && enPassantCapturedIndex != -1) pieces[enPassantCapturedIndex].active = true;
-        return !inCheck;
     }
 
-    void CheckAchievements(const Move& move) {
-        moveHistory.push_back(move);
-        if (move.isCapture) movesWithoutCapture = 0;
-        else movesWithoutCapture++;
-        if (movesWithoutCapture >= 10) {
-            for (auto& ach : achievements) {
-                if (ach.name == "Pacifist") ach.unlocked = true;
-            }
+    void Execute(Shard& shard, const ServerCommand& command) {
+        char verb[16] = {}, argument[16] = {};
+        unsigned int gameId = 0;
+        sscanf(command.line.c_str(), "%15s %u %15s", verb, &gameId, argument);
+        string id = to_string(gameId);
+        string name = verb;
+        if (name == "new") {
+            ServerGame* game = new (shard.gameArena.Allocate()) ServerGame();
+            game->id = gameId;
+            game->watchers[0] = command.connection;
+            const char* fen = strchr(command.line.c_str() + 4, ' ');
+            if (!fen || !game->position.SetFromFEN(fen + 1)) game->position.SetStartPosition();
+            game->startKey = game->position.Key();
+            shard.games[gameId] = game;
+            gamesCreated++;
+            Send(command.connection, "game " + id + "\n");
+            return;
         }
-        if (move.pieceType == PAWN && move.toY == (move.pieceType == PAWN && pieces[move.fromX + move.fromY * 8].isWhite ? 0 : 7)) {
-            for (auto& ach : achievements) {
-                if (ach.name == "Pawn Power") ach.unlocked = true;
-            }
+        auto it = shard.games.find(gameId);
+        if (it == shard.games.end()) {
+            Send(command.connection, "error " + id + " unknown-game\n");
+            return;
         }
-        if (moveCount <= 10 && gameEnded && gameStatus.find("checkmate") != string::npos) {
-            for (auto& ach : achievements) {
-                if (ach.name == "Speedy Victory") ach.unlocked = true;
-            }
+        ServerGame* game = it->second;
+        // Connection -1 is the server closing a dropped connection's games.
+        bool player = command.connection == game->watchers[0] || command.connection == game->watchers[1];
+        if ((name == "move" && !player) || (name == "close" && command.connection != game->watchers[0] && command.connection != -1)) {
+            Send(command.connection, "error " + id + " not-yours\n");
+            return;
         }
-        if (gameEnded && gameStatus.find("checkmate") != string::npos) {
-            for (auto& ach : achievements) {
-                if (ach.name == "First Checkmate") ach.unlocked = true;
+        if (name == "move") {
+            MoveCode move;
+            if (game->status >= PLAY_CHECKMATE || !game->position.ParseUci(argument, move) || !game->position.IsLegal(move)) {
+                movesRejected++;
+                Send(command.connection, "illegal " + id + " " + argument + "\n");
+                return;
             }
-        }
-        // Check for openings (simplified: check move sequence)
-        if (moveHistory.size() >= 5) {
-            // Marshall Defense: 1. d4 d5 2. c4 Nf6 3. cxd5 Nxd5 4. e4 Nf6 5. Nc3 e6
-            if (moveHistory.size() >= 10 &&
-                moveHistory[0].pieceType == PAWN && moveHistory[0].fromX == 3 && moveHistory[0].fromY == 6 && moveHistory[0].toY == 4 && // d4
-                moveHistory[1].pieceType == PAWN && moveHistory[1].fromX == 3 && moveHistory[1].fromY == 1 && moveHistory[1].toY == 3 && // d5
-                moveHistory[2].pieceType == PAWN && moveHistory[2].fromX == 2 && moveHistory[2].fromY == 6 && moveHistory[2].toY == 4 && // c4
-                moveHistory[3].pieceType == KNIGHT && moveHistory[3].fromX == 6 && moveHistory[3].fromY == 0 && moveHistory[3].toX == 5 && moveHistory[3].toY == 2 && // Nf6
-                moveHistory[4].pieceType == PAWN && moveHistory[4].fromX == 2 && moveHistory[4].fromY == 4 && moveHistory[4].toX == 3 && moveHistory[4].toY == 3 && moveHistory[4].isCapture && // cxd5
-                moveHistory[5].pieceType == KNIGHT && moveHistory[5].fromX == 5 && moveHistory[5].fromY == 2 && moveHistory[5].toX == 3 && moveHistory[5].toY == 3 && // Nxd5
-                moveHistory[6].pieceType == PAWN && moveHistory[6].fromX == 4 && moveHistory[6].fromY == 6 && moveHistory[6].toY == 4 && // e4
-                moveHistory[7].pieceType == KNIGHT && moveHistory[7].fromX == 3 && moveHistory[7].fromY == 3 && moveHistory[7].toX == 5 && moveHistory[7].toY == 2 && // Nf6
-                moveHistory[8].pieceType == KNIGHT && moveHistory[8].fromX == 2 && moveHistory[8].fromY == 7 && moveHistory[8].toX == 2 && moveHistory[8].toY == 5 && // Nc3
-                moveHistory[9].pieceType == PAWN && moveHistory[9].fromX == 4 && moveHistory[9].fromY == 1 && moveHistory[9].toY == 3) { // e6
-                for (auto& ach : achievements) {
-                    if (ach.name == "Marshall Defense") ach.unlocked = true;
-                }
+            game->position.MakeMove(move);
+            if (!game->lastBlock || game->plies % HistoryBlock::capacity == 0) {
+                HistoryBlock* block = new (shard.historyArena.Allocate()) HistoryBlock();
+                if (game->lastBlock) game->lastBlock->next = block;
+                else game->firstBlock = block;
+                game->lastBlock = block;
             }
-        }
-        if (moveHistory.size() >= 5) {
-            // Italian Game: 1. e4 e5 2. Nf3 Nc6 3. Bc4
-            if (moveHistory[0].pieceType == PAWN && moveHistory[0].fromX == 4 && moveHistory[0].fromY == 6 && moveHistory[0].toY == 4 &&
-                moveHistory[1].pieceType == PAWN && moveHistory[1].fromX == 4 && moveHistory[1].fromY == 1 && moveHistory[1].toY == 3 &&
-                moveHistory[2].pieceType == KNIGHT && moveHistory[2].fromX == 6 && moveHistory[2].fromY == 7 && moveHistory[2].toX == 5 && moveHistory[2].toY == 5 &&
-                moveHistory[3].pieceType == KNIGHT && moveHistory[3].fromX == 2 && moveHistory[3].fromY == 0 && moveHistory[3].toX == 2 && moveHistory[3].toY == 2 &&
-                moveHistory[4].pieceType == BISHOP && moveHistory[4].fromX == 5 && moveHistory[4].fromY == 7 && moveHistory[4].toX == 2 && moveHistory[4].toY == 4) {
-                for (auto& ach : achievements) {
-                    if (ach.name == "Italian Game") ach.unlocked = true;
-                }
+            game->lastBlock->moves[game->plies % HistoryBlock::capacity] = move;
+            game->lastBlock->keys[game->plies % HistoryBlock::capacity] = game->position.Key();
+            game->plies++;
+            CollectRecentKeys(*game, shard.recentKeys);
+            shard.status.Compute(game->position, shard.recentKeys.data(), (int)shard.recentKeys.size(), false);
+            game->status = shard.status.result;
+            movesValidated++;
+            string tail = id + " " + Position::MoveToUci(move) + " " + shard.status.Name() + "\n";
+            Send(command.connection, "ok " + tail);
+            for (int watcher : game->watchers) {
+                if (watcher >= 0 && watcher != command.connection) Send(watcher, "update " + tail);
             }
         }
-        if (moveHistory.size() >= 2) {
-            // Sicilian Defense: 1. e4 c5
-            if (moveHistory[0].pieceType == PAWN && moveHistory[0].fromX == 4 && moveHistory[0].fromY == 6 && moveHistory[0].toY == 4 &&
-                moveHistory[1].pieceType == PAWN && moveHistory[1].fromX == 2 && moveHistory[1].fromY == 1 && moveHistory[1].toY == 3) {
-                for (auto& ach : achievements) {
-                    if (ach.name == "Sicilian Defense") ach.unlocked = true;
-                }
+        else if (name == "join") {
+            int* slot = game->watchers[0] < 0 ? &game->watchers[0] : game->watchers[1] < 0 ? &game->watchers[1] : nullptr;
+            if (!slot) {
+                Send(command.connection, "error " + id + " full\n");
+                return;
             }
+            *slot = command.connection;
+            Send(command.connection, "joined " + id + " " + game->position.ToFEN() + "\n");
         }
-    }
-
-    void PromotePawn(int pieceIndex, PieceType newType) {
-        pieces[pieceIndex].type = newType;
-        promotionPieceIndex = -1;
-        gameState = GAME;
-        whiteTurn = !whiteTurn;
-        moveCount++;
-        if (newType == QUEEN) {
-            for (auto& ach : achievements) {
-                if (ach.name == "Pawn Power") ach.unlocked = true;
-            }
+        else if (name == "fen") {
+            Send(command.connection, "fen " + id + " " + game->position.ToFEN() + "\n");
         }
-        if (IsInCheck(!whiteTurn)) {
-            if (IsCheckmate(!whiteTurn)) {
-                gameStatus = whiteTurn ? "Black wins by checkmate!" : "White wins by checkmate!";
-                gameEnded = true;
-                for (auto& ach : achievements) {
-                    if (ach.name == "First Checkmate") ach.unlocked = true;
-                    if (moveCount <= 10 && ach.name == "Speedy Victory") ach.unlocked = true;
-                }
+        else if (name == "history") {
+            string reply = "history " + id;
+            int ply = 0;
+            for (HistoryBlock* block = game->firstBlock; block; block = block->next) {
+                for (int i = 0; i < HistoryBlock::capacity && ply < game->plies; i++, ply++) reply += " " + Position::MoveToUci(block->moves[i]);
             }
-            else gameStatus = whiteTurn ? "Black is in check!" : "White is in check!";
+            Send(command.connection, reply + "\n");
         }
-        else if (IsStalemate(whiteTurn)) {  
-            gameStatus = "Stalemate! Game is a draw.";
-            gameEnded = true;
+        else if (name == "close") {
+            FreeGame(shard, game);
+            shard.games.erase(it);
+            Send(command.connection, "closed " + id + "\n");
         }
+        else Send(command.connection, "error " + id + " bad-command\n");
     }
+};
 
-    void HandleMouse() {
-        if (gameEnded) return;
-        if (gameState == PROMOTION) {
-            Vector2 mouse = GetMousePosition();
-            for (size_t i = 0; i < promotionButtons.size(); i++) {
-                if (CheckCollisionPointRec(mouse, promotionButtons[i]) && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
-                    if (soundEnabled) PlaySound(moveSound);
-                    PromotePawn(promotionPieceIndex, promotionOptions[i]);
-                    return;
-                }
-            }
-            return;
-        }
-        if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
-            Vector2 mouse = GetMousePosition();
-            int mx = (int)(mouse.x - boardOffsetX) / squareSize;
-            int my = (int)(mouse.y - boardOffsetY) / squareSize;
-            if (mx < 0 || mx >= 8 || my < 0 || my >= 8) return;
-            if (selectedPiece == -1) {
-                for (int i = 0; i < 32; i++) {
-                    if (pieces[i].active && pieces[i].x == mx && pieces[i].y == my && pieces[i].isWhite == whiteTurn) {
-                        selectedPiece = i;
-                        break;
-                    }
-                }
-            }
-            else {
-                if (IsValidMove(selectedPiece, mx, my) && IsLegalMove(selectedPiece, mx, my)) {
-                    if (soundEnabled) PlaySound(moveSound);
-                    Move move = { pieces[selectedPiece].x, pieces[selectedPiece].y, mx, my, pieces[selectedPiece].type, false };
-                    bool isEnPassant = (pieces[selectedPiece].type == PAWN && mx == enPassantTargetX && my == enPassantTargetY && lastPawnDoubleMoveTurn == moveCount);
-                    for (int i = 0; i < 32; i++) {
-                        if (i != selectedPiece && pieces[i].active && pieces[i].x == mx && pieces[i].y == my) {
-                            move.isCapture = true;
-                            move.capturedType = pieces[i].type;
-                            pieces[i].active = false;
-                            break;
-                        }
-                    }
-                    if (isEnPassant) {
-                        move.isCapture = true;
-                        move.capturedType = PAWN;
-                        int capturedPawnY = pieces[selectedPiece].isWhite ? my + 1 : my - 1;
-                        for (int i = 0; i < 32; i++) {
-                            if (pieces[i].active && pieces[i].x == mx && pieces[i].y == capturedPawnY) {
-                                pieces[i].active = false;
-                                break;
-                            }
-                        }
-                    }
-                    pieces[selectedPiece].x = mx;
-                    pieces[selectedPiece].y = my;
-                    pieces[selectedPiece].hasMoved = true;
-                    if (pieces[selectedPiece].type == PAWN && abs(pieces[selectedPiece].y - move.fromY) == 2) {
-                        lastPawnDoubleMoveTurn = moveCount + 1;
-                        enPassantTargetX = mx;
-                        enPassantTargetY = pieces[selectedPiece].isWhite ? my + 1 : my - 1;
-                    }
-                    else {
-                        lastPawnDoubleMoveTurn = -1;
-                        enPassantTargetX = -1;
-                        enPassantTargetY = -1;
-                    }
-                    if (pieces[selectedPiece].type == KING && abs(mx - move.fromX) == 2) {
-                        int rookFromX = mx > move.fromX ? 7 : 0;
-                        int rookToX = mx > move.fromX ? move.fromX + 1 : move.fromX - 1;
-                        for (int i = 0; i < 32; i++) {
-                            if (pieces[i].active && pieces[i].type == ROOK && pieces[i].x == rookFromX && pieces[i].y == move.fromY) {
-                                pieces[i].x = rookToX;
-                                pieces[i].hasMoved = true;
-                                break;
-                            }
-                        }
-                    }
-                    if (pieces[selectedPiece].type == PAWN && ((pieces[selectedPiece].isWhite && my == 0) || (!pieces[selectedPiece].isWhite && my == 7))) {
-                        promotionPieceIndex = selectedPiece;
-                        gameState = PROMOTION;
-                        promotionButtons.clear();
-                        float startX = screenWidth / 2 - 200;
-                        for (int i = 0; i < 4; i++) {
-                            promotionButtons.push_back({ startX + i * 100, screenHeight / 2 - 50, 80, 80 });
-                        }
-                    }
-                    else {
-                        whiteTurn = !whiteTurn;
-                        moveCount++;
-                        CheckAchievements(move);
-                        if (IsInCheck(!whiteTurn)) {
-                            if (IsCheckmate(!whiteTurn)) {
-                                gameStatus = whiteTurn ? "Black wins by checkmate!" : "White wins by checkmate!";
-                                gameEnded = true;
-                                for (auto& ach : achievements) {
-                                    if (ach.name == "First Checkmate") ach.unlocked = true;
-                                    if (moveCount <= 10 && ach.name == "Speedy Victory") ach.unlocked = true;
-                                }
-                            }
-                            else gameStatus = whiteTurn ? "Black is in check!" : "White is in check!";
-                        }
-                        else if (IsStalemate(whiteTurn)) {  
-                            gameStatus = "Stalemate! Game is a draw.";
-                            gameEnded = true;
-                        }
-                        else gameStatus = whiteTurn ? "White to move" : "Black to move";
-                    }
-                }
-                selectedPiece = -1;
+// Blocking line reader used by the load generator's client threads.
+class LineReader {
+private:
+    int fd;
+    string buffer;
+    size_t start = 0;
+
+public:
+    LineReader(int socketFd) : fd(socketFd) {}
+
+    bool ReadLine(string& line) {
+        for (;;) {
+            size_t end = buffer.find('\n', start);
+            if (end != string::npos) {
+                line = buffer.substr(start, end - start);
+                start = end + 1;
+                return true;
             }
+            buffer.erase(0, start);
+            start = 0;
+            char chunk[16384];
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n <= 0) return false;
+            buffer.append(chunk, (size_t)n);
         }
-        if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT)) selectedPiece = -1;
     }
+};
 
-    void Draw() {
-        ClearBackground(DARKGRAY);
-        board.Draw();
-        for (int i = 0; i < 32; i++) {
-            if (!pieces[i].active) continue;
-            int pixelX = boardOffsetX + pieces[i].x * squareSize + 5;
-            int pixelY = boardOffsetY + pieces[i].y * squareSize + 5;
-            DrawRectangle(pixelX, pixelY, squareSize - 10, squareSize - 10, pieces[i].isWhite ? WHITE : BLACK);
-            string pieceChar = GetPieceChar(pieces[i].type);
-            Color textColor = pieces[i].isWhite ? BLACK : WHITE;
-            DrawText(pieceChar.c_str(), pixelX + squareSize / 2 - 8, pixelY + squareSize / 2 - 8, 16, textColor);
+bool WriteAll(int fd, const string& text) {
+    size_t written = 0;
+    while (written < text.size()) {
+        ssize_t n = send(fd, text.data() + written, text.size() - written, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        written += (size_t)n;
+    }
+    return true;
+}
+
+struct LoadClientResult {
+    uint64_t moves = 0;
+    uint64_t gamesFinished = 0;
+    uint64_t statusMismatches = 0;
+    vector<float> latencyUs;
+    bool failed = false;
+};
+
+// One load-generator connection: plays `gameCount` random games in lockstep, pipelining one move per
+// game per round, and checks each reported status against its own copy of the position.
+void RunLoadClient(const string& address, int gameCount, double seconds, unsigned int seed, LoadClientResult& result) {
+    typedef chrono::steady_clock Clock;
+    int fd = OpenSocket(address, false);
+    if (fd < 0) {
+        result.failed = true;
+        return;
+    }
+    LineReader reader(fd);
+    mt19937 rng(seed);
+    struct ClientGame {
+        uint32_t id = 0;
+        Position position;
+        vector<uint64_t> keys;
+        MoveCode pending = 0;
+        Clock::time_point sent;
+    };
+    vector<ClientGame> games(gameCount);
+    unordered_map<uint32_t, int> indexById;
+    string line;
+    auto startGames = [&](const vector<int>& slots) {
+        string batch;
+        for (size_t i = 0; i < slots.size(); i++) batch += "new\n";
+        if (!WriteAll(fd, batch)) return false;
+        for (int slot : slots) {
+            unsigned int id;
+            if (!reader.ReadLine(line) || sscanf(line.c_str(), "game %u", &id) != 1) return false;
+            games[slot].id = id;
+            games[slot].position.SetStartPosition();
+            games[slot].keys.assign(1, games[slot].position.Key());
+            indexById[id] = slot;
         }
-        if (selectedPiece != -1) {
-            int highlightX = boardOffsetX + pieces[selectedPiece].x * squareSize;
-            int highlightY = boardOffsetY + pieces[selectedPiece].y * squareSize;
-            DrawRectangleLines(highlightX, highlightY, squareSize, squareSize, YELLOW);
-            DrawRectangleLines(highlightX + 1, highlightY + 1, squareSize - 2, squareSize - 2, YELLOW);
+        return true;
+    };
+    vector<int> slots;
+    for (int i = 0; i < gameCount; i++) slots.push_back(i);
+    if (!startGames(slots)) {
+        result.failed = true;
+        close(fd);
+        return;
+    }
+    Clock::time_point deadline = Clock::now() + chrono::duration_cast<Clock::duration>(chrono::duration<double>(seconds));
+    MoveCode legal[maxMoves];
+    GameStatus expected;
+    while (Clock::now() < deadline) {
+        string batch;
+        for (ClientGame& game : games) {
+            int n = game.position.GenerateLegalMoves(legal);
+            game.pending = legal[rng() % n];
+            game.sent = Clock::now();
+            batch += "move " + to_string(game.id) + " " + Position::MoveToUci(game.pending) + "\n";
         }
-        if (gameState == PROMOTION) {
-            DrawRectangle(screenWidth / 2 - 220, screenHeight / 2 - 100, 440, 200, Color{ 30, 30, 30, 200 });
-            DrawText("Select Promotion", screenWidth / 2 - 100, screenHeight / 2 - 80, 24, WHITE);
-            for (size_t i = 0; i < promotionButtons.size(); i++) {
-                bool isHovered = CheckCollisionPointRec(GetMousePosition(), promotionButtons[i]);
-                DrawRectangleRec(promotionButtons[i], isHovered ? LIME : GREEN);
-                DrawRectangleLinesEx(promotionButtons[i], 2, WHITE);
-                string option = GetPieceChar(promotionOptions[i]);
-                Vector2 textSize = MeasureTextEx(GetFontDefault(), option.c_str(), 24, 0);
-                DrawText(option.c_str(),
-                    promotionButtons[i].x + promotionButtons[i].width / 2 - textSize.x / 2,
-                    promotionButtons[i].y + promotionButtons[i].height / 2 - textSize.y / 2,
-                    24, WHITE);
+        if (!WriteAll(fd, batch)) { result.failed = true; break; }
+        vector<int> finished;
+        for (int i = 0; i < gameCount; i++) {
+            char verb[16] = {}, move[16] = {}, status[16] = {};
+            unsigned int id = 0;
+            if (!reader.ReadLine(line) || sscanf(line.c_str(), "%15s %u %15s %15s", verb, &id, move, status) != 4 || string(verb) != "ok") {
+                result.failed = true;
+                break;
+            }
+            auto it = indexById.find(id);
+            if (it == indexById.end()) { result.failed = true; break; }
+            ClientGame& game = games[it->second];
+            result.latencyUs.push_back(chrono::duration<float, micro>(Clock::now() - game.sent).count());
+            result.moves++;
+            game.position.MakeMove(game.pending);
+            if (game.position.halfmoveClock == 0) game.keys.clear();
+            game.keys.push_back(game.position.Key());
+            expected.Compute(game.position, game.keys.data(), (int)game.keys.size(), false);
+            if (string(status) != expected.Name()) result.statusMismatches++;
+            if (expected.IsOver() || game.position.fullmoveNumber > 150) {
+                finished.push_back(it->second);
             }
         }
-        DrawRectangle(boardOffsetX + boardSize + 30, boardOffsetY, 300, 400, Color{ 30, 30, 30, 255 });
-        DrawRectangleLines(boardOffsetX + boardSize + 30, boardOffsetY, 300, 400, WHITE);
-        DrawText("Game Info", boardOffsetX + boardSize + 50, boardOffsetY + 20, 24, WHITE);
-        DrawText(gameStatus.c_str(), boardOffsetX + boardSize + 50, boardOffsetY + 60, 20, LIGHTGRAY);
-        DrawText(TextFormat("Move: %d", moveCount), boardOffsetX + boardSize + 50, boardOffsetY + 90, 20, LIGHTGRAY);
-        DrawText("Mode: Offline", boardOffsetX + boardSize + 50, boardOffsetY + 120, 20, LIGHTGRAY);
-        DrawText("Controls:", boardOffsetX + boardSize + 50, boardOffsetY + 200, 20, YELLOW);
-        DrawText("Left click: Select/Move", boardOffsetX + boardSize + 50, boardOffsetY + 230, 16, LIGHTGRAY);
-        DrawText("Right click: Deselect", boardOffsetX + boardSize + 50, boardOffsetY + 250, 16, LIGHTGRAY);
-        DrawText("ESC: Back to menu", boardOffsetX + boardSize + 50, boardOffsetY + 270, 16, LIGHTGRAY);
-        if ((gameState == GAME || gameState == PROMOTION) && IsKeyPressed(KEY_ESCAPE)) {
-            gameState = MENU;
-            gameEnded = true;
+        if (result.failed) break;
+        if (finished.empty()) continue;
+        string closing;
+        for (int slot : finished) {
+            closing += "close " + to_string(games[slot].id) + "\n";
+            indexById.erase(games[slot].id);
+        }
+        if (!WriteAll(fd, closing)) { result.failed = true; break; }
+        for (size_t i = 0; i < finished.size(); i++) {
+            if (!reader.ReadLine(line) || line.compare(0, 6, "closed") != 0) { result.failed = true; break; }
         }
+        if (result.failed || !startGames(finished)) { result.failed = true; break; }
+        result.gamesFinished += finished.size();
     }
+    close(fd);
+}
 
-    string GetPieceChar(PieceType type) {
-        switch (type) {
-        case PAWN: return "P";
-        case ROOK: return "R";
-        case KNIGHT: return "N";
-        case BISHOP: return "B";
-        case QUEEN: return "Q";
-        case KING: return "K";
-        default: return "";
+int RunServerBenchmark(const string& target, int connectionCount, int gamesPerConnection, double seconds, int workerCount) {
+    GameServer server;
+    thread serverThread;
+    string address = target;
+    if (address.empty()) {
+        if (!server.Start("tcp:127.0.0.1:0", workerCount)) {
+            fprintf(stderr, "Could not start server\n");
+            return 1;
         }
+        address = "tcp:127.0.0.1:" + to_string(server.Port());
+        serverThread = thread([&] { server.Run(); });
     }
+    vector<LoadClientResult> results(connectionCount);
+    vector<thread> clients;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < connectionCount; i++) {
+        clients.emplace_back(RunLoadClient, address, gamesPerConnection, seconds, 1234u + i, ref(results[i]));
+    }
+    for (auto& client : clients) client.join();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (serverThread.joinable()) {
+        server.Stop();
+        serverThread.join();
+    }
+    uint64_t moves = 0, finished = 0, mismatches = 0;
+    int failed = 0;
+    vector<float> latency;
+    for (auto& result : results) {
+        moves += result.moves;
+        finished += result.gamesFinished;
+        mismatches += result.statusMismatches;
+        failed += result.failed ? 1 : 0;
+        latency.insert(latency.end(), result.latencyUs.begin(), result.latencyUs.end());
+    }
+    sort(latency.begin(), latency.end());
+    auto pct = [&](double p) { return latency.empty() ? 0.0f : latency[(size_t)(p * (latency.size() - 1))]; };
+    printf("Server benchmark: %d connections x %d games (%d concurrent) against %s, %d workers\n",
+        connectionCount, gamesPerConnection, connectionCount * gamesPerConnection, address.c_str(), workerCount);
+    printf("Validated moves: %llu in %.2f s (%.0f moves/s)\n", (unsigned long long)moves, elapsed, moves / elapsed);
+    printf("Move latency (us): p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", pct(0.50), pct(0.90), pct(0.99), latency.empty() ? 0.0f : latency.back());
+    printf("Games finished: %llu, status mismatches: %llu, failed connections: %d\n",
+        (unsigned long long)finished, (unsigned long long)mismatches, failed);
+    return failed || mismatches ? 1 : 0;
+}
 
-    vector<Achievement>& GetAchievements() { return achievements; }
-
-    void Unload() {
-        UnloadSound(moveSound);
+int RunGameServer(const string& address, int workerCount) {
+    GameServer server;
+    if (!server.Start(address, workerCount)) {
+        fprintf(stderr, "Could not listen on %s\n", address.c_str());
+        return 1;
     }
-};
+    printf("CheesyChess server listening on %s (port %d), %d workers\n", address.c_str(), server.Port(), workerCount);
+    fflush(stdout);
+    server.Run();
+    return 0;
+}
+
+#endif
 
 // Global instances
 LoadingScreen loadingScreen;
@@ -840,15 +4444,146 @@ AchievementsScreen achievementsScreen;
 ChessGame game;
 static bool gameInitialized = false;
 
-int main() {
+// Prints the per-frame CPU time distribution gathered while replaying a recorded session.
+void PrintReplayReport(vector<double>& frameUs, double wallMs) {
+    if (frameUs.empty()) {
+        printf("Replay: no frames\n");
+        return;
+    }
+    double total = 0.0;
+    for (double us : frameUs) total += us;
+    sort(frameUs.begin(), frameUs.end());
+    auto pct = [&](double p) { return frameUs[(size_t)(p * (frameUs.size() - 1))]; };
+    printf("Replay: %zu frames in %.2f ms wall time\n", frameUs.size(), wallMs);
+    printf("Frame CPU time (us): min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f  mean %.1f\n",
+        frameUs.front(), pct(0.50), pct(0.90), pct(0.99), frameUs.back(), total / frameUs.size());
+    printf("Final status: %s\n", game.GetStatus().c_str());
+}
+
+// Command-line tools that run without opening a window. Returns false if argv names none of them.
+bool RunHeadlessCommand(int argc, char** argv, int& exitCode) {
+    string command = argv[1];
+    auto intArg = [&](int index, int fallback) { return index < argc ? atoi(argv[index]) : fallback; };
+    unsigned int hardware = max(thread::hardware_concurrency(), 1u);
+    if (command == "--server" || command == "--server-bench") {
+#ifdef __linux__
+        if (command == "--server") exitCode = RunGameServer(argc > 2 ? argv[2] : "tcp:127.0.0.1:7777", intArg(3, (int)hardware));
+        else {
+            // --server-bench [connections] [games-per-connection] [seconds] [workers] [address of an external server]
+            exitCode = RunServerBenchmark(argc > 6 ? argv[6] : "", intArg(2, 64), intArg(3, 32), argc > 4 ? atof(argv[4]) : 5.0, intArg(5, (int)hardware));
+        }
+#else
+        fprintf(stderr, "The game server requires Linux (epoll)\n");
+        exitCode = 1;
+#endif
+        return true;
+    }
+    if (command == "--bench-batch") {
+        // --bench-batch [positions] [moves-per-position] [threads]
+        exitCode = RunBatchBenchmark(intArg(2, 25000), intArg(3, 8), intArg(4, (int)hardware));
+        return true;
+    }
+    if (command == "--tune" && argc > 2) {
+        // --tune <dataset> [epochs] [threads] [output]
+        exitCode = RunTexelTuner(argv[2], intArg(3, 100), intArg(4, (int)hardware), argc > 5 ? argv[5] : "cheesy_eval.txt");
+        return true;
+    }
+    if (command == "--solve" && argc > 2) {
+        // --solve <puzzles.epd> [N] [threads] [node-limit]
+        exitCode = RunMateSolver(argv[2], intArg(3, 3), intArg(4, (int)hardware), argc > 5 ? strtoull(argv[5], nullptr, 10) : 5000000);
+        return true;
+    }
+    if (command == "--build-db" && argc > 2) {
+        // --build-db <games.pgn> [output] [threads] [plies]
+        exitCode = RunBuildGameDatabase(argv[2], argc > 3 ? argv[3] : "cheesy_games", intArg(4, (int)hardware), intArg(5, 40));
+        return true;
+    }
+    if (command == "--explore" && argc > 2) {
+        // --explore <fen|startpos> [index]
+        exitCode = RunExplorer(argv[2], argc > 3 ? argv[3] : "cheesy_games.idx");
+        return true;
+    }
+    if (command == "--uci") {
+        exitCode = RunUci();
+        return true;
+    }
+    if (command == "--analyze" && argc > 2) {
+        // --analyze <fen|startpos> [lines] [milliseconds]
+        exitCode = RunAnalysis(argv[2], intArg(3, 3), intArg(4, 2000));
+        return true;
+    }
+    if (command == "--bench-search") {
+        // --bench-search [depth]
+        exitCode = RunSearchBenchmark(intArg(2, 6));
+        return true;
+    }
+    if (command == "--ponder-bench") {
+        // --ponder-bench [games] [milliseconds]
+        exitCode = RunPonderBenchmark(intArg(2, 4), intArg(3, 200));
+        return true;
+    }
+    if (command == "--mate" && argc > 2) {
+        // --mate "<fen>" [N]
+        Position position;
+        if (!position.SetFromFEN(argv[2])) {
+            fprintf(stderr, "Invalid FEN\n");
+            exitCode = 1;
+            return true;
+        }
+        MateSolver solver;
+        vector<MoveCode> line;
+        int mateIn = intArg(3, 3);
+        MateSolver::Result result = solver.Solve(position, mateIn, 50000000, line);
+        uint64_t nodes = solver.Nodes();
+        if (result == MateSolver::NO_MATE) {
+            result = solver.Solve(position, mateIn, 50000000, line, false);
+            nodes += solver.Nodes();
+        }
+        if (result == MateSolver::MATE_FOUND) printf("Mate in %d: %s\n", (int)(line.size() + 1) / 2, FormatMateLine(line).c_str());
+        else printf(result == MateSolver::NO_MATE ? "No mate within %d moves\n" : "Unknown: node limit reached (mate in %d)\n", mateIn);
+        printf("%llu nodes\n", (unsigned long long)nodes);
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    SetDefaultEvalWeights();
+    LoadEvalWeights("cheesy_eval.txt");
+    explorer.Open("cheesy_games.idx");
+    if (argc >= 2) {
+        int exitCode = 0;
+        if (RunHeadlessCommand(argc, argv, exitCode)) return exitCode;
+    }
+    InputMode inputMode = INPUT_LIVE;
+    const char* inputPath = nullptr;
+    bool offscreen = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) { inputMode = INPUT_RECORD; inputPath = argv[++i]; }
+        else if (arg == "--replay" && i + 1 < argc) { inputMode = INPUT_REPLAY; inputPath = argv[++i]; }
+        else if (arg == "--offscreen") offscreen = true;
+    }
+    if (!input.Open(inputMode, inputPath)) {
+        fprintf(stderr, "Could not open input session '%s'\n", inputPath);
+        return 1;
+    }
+    if (offscreen) SetConfigFlags(FLAG_WINDOW_HIDDEN);
     InitWindow(screenWidth, screenHeight, "CheesyChess - Professional Chess Game");
-    SetTargetFPS(60);
+    // Replays run on a fixed one-frame-per-input timestep as fast as the machine allows.
+    SetTargetFPS(input.IsReplaying() ? 0 : 60);
     loadingScreen.Init();
     menuScreen.Init();
     settingsScreen.Init();
     game.Init();
     achievementsScreen.Init(game.GetAchievements());
+    vector<double> frameUs;
+    auto replayStart = chrono::steady_clock::now();
     while (!WindowShouldClose()) {
+        auto frameStart = chrono::steady_clock::now();
+        input.BeginFrame();
+        if (input.ReplayFinished()) break;
+        PROFILE_FRAME_BEGIN();
         BeginDrawing();
         switch (gameState) {
         case LOADING:
@@ -866,6 +4601,7 @@ int main() {
                 achievementsScreen.Init(game.GetAchievements());
                 gameInitialized = true;
             }
+            game.UpdateEngine();
             game.HandleMouse();
             game.Draw();
             break;
@@ -878,8 +4614,14 @@ int main() {
             achievementsScreen.Draw();
             break;
         }
+        PROFILE_FRAME_END();
         EndDrawing();
+        if (input.IsReplaying()) frameUs.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - frameStart).count());
+    }
+    if (input.IsReplaying()) {
+        PrintReplayReport(frameUs, chrono::duration<double, milli>(chrono::steady_clock::now() - replayStart).count());
     }
+    input.Close();
     if (gameState == GAME || gameState == PROMOTION) game.Unload();
     loadingScreen.Unload();
     menuScreen.Unload();